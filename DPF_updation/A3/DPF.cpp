@@ -1,158 +1,601 @@
 #include <bits/stdc++.h>
 #include "DPF.hpp"
-#include "utility.hpp" // for mod/norm if needed
+#include "utility.hpp" // for Ring/norm
+#include "thread_pool.hpp"
 using namespace std;
 
 // typedefs for convinence
 // typedef uint64_t u64;   // moved to header
 static random_device rd;  // obtain a random number from hardware
+static mutex rdMutex;     // keys may be generated on several threads at once
 
-// structure to hold the left and right child seeds and flags
-struct child{
-    u64 leftSeed, rightSeed;
-    bool leftFlag, rightFlag;
+// Key material for one thread: a secret drawn once from random_device and
+// stretched with the PRG backend in counter mode, H(secret + i). Only the first
+// draw on each thread takes rdMutex, so bulk generation does not serialize on it.
+class KeyRandom {
+public:
+    KeyRandom() {
+        lock_guard<mutex> lock(rdMutex);
+        secret = ((u64)rd() << 32) | rd();
+    }
+
+    u64 next() {
+        if (pos == 2) {
+            DefaultPRG::convert(secret + ctr++, buf);
+            pos = 0;
+        }
+        return buf[pos++];
+    }
+
+private:
+    u64 secret, ctr = 0;
+    u64 buf[2];
+    int pos = 2;
 };
 
-// child PRG
-static child Expand(u64 seed, u64 ctr_base = 0){
-    mt19937_64 prng(seed);
-    child next;
-    next.leftSeed = prng();
-    next.rightSeed = prng();
-    next.leftFlag = (prng() & 1ULL);
-    next.rightFlag = (prng() & 1ULL);
-    return next;
+static u64 randomWord(){
+    thread_local KeyRandom rng;
+    return rng.next();
+}
+
+static u64 treeDepth(u64 N){
+    return FlagDPF::treeDepth(N);
+}
+
+static u64 leafShift(u64 N){
+    return FlagDPF::leafShift(N);
+}
+
+static u64 nodesCovering(u64 leaves, u64 h) {
+    return FlagDPF::nodesCovering(leaves, h);
+}
+
+// Location flags [from, from + count) of the leaf block held by (seed, flag)
+static void leafFlags(const DPFKey& key, u64 seed, bool flag, u64 from, u64 count, uint8_t* out) {
+    leafBlock leaf = FlagDPF::leafOutput(key, seed, flag);
+    for (u64 j = 0; j < count; ++j) out[j] = BitGroup::element(leaf, from + j);
+}
+
+// Converts consecutive leaf blocks into `count` location flags, starting `skip`
+// locations into the first block
+static void convertLeaves(const DPFKey& key, u64 shift, const vector<u64>& seeds,
+                          const vector<uint8_t>& flags, u64 skip, u64 count, uint8_t* out) {
+    u64 width = 1ULL << shift;
+    for (u64 p = 0, done = 0; done < count; ++p) {
+        u64 take = min<u64>(width - skip, count - done);
+        leafFlags(key, seeds[p], flags[p], skip, take, out + done);
+        done += take;
+        skip = 0;
+    }
+}
+
+u64 dpfTreeDepth(u64 N){
+    return treeDepth(N);
 }
 
 DPFKey::DPFKey(int n){
-    seed = rd();
+    seed = randomWord();
     cw_s.resize(n);
     t0 = 0;
     final_cw = 0;
 }
 
 pair<DPFKey, DPFKey> generateDPF(u64 location, u64 value, u64 N){
-    if(location>=N) throw runtime_error("location must in [0,N)");
-    u64 depth = N<=1?0:(int)ceil(log2(N));
+    (void)value;    // the payload is carried by final_cw
+    u64 seed0 = randomWord();
+    u64 seed1 = randomWord();
+    auto [t0, t1] = FlagDPF::generate(location, /*flag at location=*/1, N, seed0, seed1);
 
-    DPFKey k0(depth), k1(depth);
-    k0.t0 = 1;
-    k1.t0 = 0;
+    DPFKey k0, k1;
+    static_cast<FlagDPF::Key&>(k0) = t0;
+    static_cast<FlagDPF::Key&>(k1) = t1;
 
-    u64 lSeed = k0.seed, rSeed = k1.seed;
-    bool lFlag = k0.t0,   rFlag = k1.t0;
+    // Split additively in the ring so FCW0 + FCW1 = 0 (so Step 3 yields FCWm = M)
+    u64 r = Ring::fromWord(randomWord());
+    k0.final_cw = (ll)r;
+    k1.final_cw = (ll)Ring::neg(r);
 
-    for(u64 level = 0; level < depth; level++){
-        bool pathBit = (location&(1ULL<<(depth-1-level)));
-        child ns0 = Expand(lSeed, level);
-        child ns1 = Expand(rSeed, level);
+    return {k0, k1};
+}
 
-        u64 correction_word;
-        bool leftAdvice  = (ns0.leftFlag  ^ ns1.leftFlag  ^ (pathBit == 0));
-        bool rightAdvice = (ns0.rightFlag ^ ns1.rightFlag ^ (pathBit == 1));
+// Return the leaf flag at a location
+bool evalFlagAt(const DPFKey& key, u64 location, u64 N) {
+    return FlagDPF::evalAt(key, location, N);
+}
 
-        if(pathBit){
-            correction_word = ns0.leftSeed ^ ns1.leftSeed;
-        }else{
-            correction_word = ns0.rightSeed ^ ns1.rightSeed;
+// Breadth-first expansion of one node on `level` down `steps` levels. The node
+// covers `leaves` leaves (< N) of the full tree and children that cover none of
+// them are never produced. On entry seeds/flags hold the start node, on exit
+// the nodes `steps` levels below it, left to right.
+static void expandDown(const DPFKey& key, u64 depth, u64 level, u64 leaves, u64 steps,
+                       vector<u64>& seeds, vector<uint8_t>& flags) {
+    vector<u64> nextSeeds;
+    vector<uint8_t> nextFlags;
+    u64 finalWidth = nodesCovering(leaves, depth - level - steps);
+    seeds.reserve(finalWidth); nextSeeds.reserve(finalWidth);
+    flags.reserve(finalWidth); nextFlags.reserve(finalWidth);
+
+    for (u64 l = level; l < level + steps; ++l) {
+        u64 width = nodesCovering(leaves, depth - 1 - l);
+        nextSeeds.resize(width);
+        nextFlags.resize(width);
+
+        for (u64 p = 0; p < seeds.size(); ++p) {
+            child ns = FlagDPF::expandNode(key, l, seeds[p], flags[p]);
+            nextSeeds[2*p] = ns.leftSeed;
+            nextFlags[2*p] = ns.leftFlag;
+            if (2*p + 1 < width) {
+                nextSeeds[2*p + 1] = ns.rightSeed;
+                nextFlags[2*p + 1] = ns.rightFlag;
+            }
         }
+        seeds.swap(nextSeeds);
+        flags.swap(nextFlags);
+    }
+}
+
+// Leaf flags at all locations in [0,N). The tree is expanded level by level so
+// every internal node is expanded exactly once, then every leaf block is
+// converted once: O(N / 128) PRG calls in total. Nodes whose subtree lies
+// entirely past N are never expanded.
+vector<uint8_t> evalFlagsFull(const DPFKey& key, u64 N) {
+    u64 depth = treeDepth(N);
+    u64 shift = leafShift(N);
+    vector<u64> seeds(1, key.seed);
+    vector<uint8_t> flags(1, key.t0);
+    expandDown(key, depth, 0, nodesCovering(N, shift), depth, seeds, flags);
+    vector<uint8_t> out(N);
+    convertLeaves(key, shift, seeds, flags, 0, N, out.data());
+    return out;
+}
+
+// Leaf flags at locations [lo, hi). Only nodes whose subtree intersects the
+// range are expanded: at most two extra nodes per level, so the cost is
+// O((hi - lo) / 128 + log N) PRG calls instead of O(N / 128).
+vector<uint8_t> evalFlagsRange(const DPFKey& key, u64 N, u64 lo, u64 hi) {
+    if (lo > hi || hi > N) throw invalid_argument("evalFlagsRange: need lo <= hi <= N");
+    if (lo == hi) return {};
+    u64 depth = treeDepth(N);
+    u64 shift = leafShift(N);
+    u64 loBlock = lo >> shift, hiBlock = ((hi - 1) >> shift) + 1;
+    vector<u64> seeds(1, key.seed), nextSeeds;
+    vector<uint8_t> flags(1, key.t0), nextFlags;
+    u64 firstNode = 0;      // index of seeds[0] on the current level
 
-        if(lFlag){
-            ns0.leftSeed  ^= correction_word;
-            ns0.leftFlag  ^= leftAdvice;
-            ns0.rightSeed ^= correction_word;
-            ns0.rightFlag ^= rightAdvice;
-        }else{
-            ns1.leftSeed  ^= correction_word;
-            ns1.leftFlag  ^= leftAdvice;
-            ns1.rightSeed ^= correction_word;
-            ns1.rightFlag ^= rightAdvice;
+    for (u64 level = 0; level < depth; ++level) {
+        u64 levelShift = depth - 1 - level;
+        u64 nextFirst = loBlock >> levelShift;
+        u64 nextLast = (hiBlock - 1) >> levelShift;
+        nextSeeds.resize(nextLast - nextFirst + 1);
+        nextFlags.resize(nextLast - nextFirst + 1);
+
+        for (u64 p = 0; p < seeds.size(); ++p) {
+            child ns = FlagDPF::expandNode(key, level, seeds[p], flags[p]);
+            u64 left = 2 * (firstNode + p);
+            if (left >= nextFirst) {
+                nextSeeds[left - nextFirst] = ns.leftSeed;
+                nextFlags[left - nextFirst] = ns.leftFlag;
+            }
+            if (left + 1 <= nextLast) {
+                nextSeeds[left + 1 - nextFirst] = ns.rightSeed;
+                nextFlags[left + 1 - nextFirst] = ns.rightFlag;
+            }
         }
+        seeds.swap(nextSeeds);
+        flags.swap(nextFlags);
+        firstNode = nextFirst;
+    }
+    vector<uint8_t> out(hi - lo);
+    convertLeaves(key, shift, seeds, flags, lo - (loBlock << shift), hi - lo, out.data());
+    return out;
+}
+
+// Level at which the tree is cut into subtrees for the pool: about 8 subtrees
+// per thread so that stealing can even out the ragged subtree past N.
+static u64 splitLevel(u64 depth, unsigned threads) {
+    u64 top = 0;
+    while (top < depth && (1ULL << top) < 8ULL * threads) ++top;
+    return top;
+}
+
+// below this many leaves the serial evaluator is faster than handing out tasks
+static const u64 kMinParallelLeaves = 1ULL << 14;
+
+// Same flags as evalFlagsFull: the top levels are expanded serially, then every
+// subtree below the split level becomes one task writing its own slice of the output.
+vector<uint8_t> evalFlagsFull(const DPFKey& key, u64 N, WorkStealingPool& pool) {
+    if (pool.size() == 1 || N < kMinParallelLeaves) return evalFlagsFull(key, N);
+    u64 depth = treeDepth(N);
+    u64 shift = leafShift(N);
+    u64 blocks = nodesCovering(N, shift);
+    u64 top = splitLevel(depth, pool.size());
+    u64 h = depth - top;
+
+    vector<u64> roots(1, key.seed);
+    vector<uint8_t> rootFlags(1, key.t0);
+    expandDown(key, depth, 0, blocks, top, roots, rootFlags);
+
+    vector<uint8_t> out(N);
+    vector<function<void()>> tasks;
+    for (u64 i = 0; i < roots.size(); ++i) {
+        tasks.push_back([&, i] {
+            u64 first = i << h;
+            u64 leaves = min<u64>(blocks, first + (1ULL << h)) - first;
+            vector<u64> seeds(1, roots[i]);
+            vector<uint8_t> flags(1, rootFlags[i]);
+            expandDown(key, depth, top, leaves, h, seeds, flags);
+            u64 firstLoc = first << shift;
+            convertLeaves(key, shift, seeds, flags, 0, min<u64>(N - firstLoc, leaves << shift), &out[firstLoc]);
+        });
+    }
+    pool.run(tasks);
+    return out;
+}
+
+static vector<int8_t> toSigns(const vector<uint8_t>& flags, bool negateThisParty) {
+    int8_t onFlag = negateThisParty ? 1 : -1;
+    vector<int8_t> s(flags.size());
+    for (size_t j = 0; j < flags.size(); ++j) s[j] = flags[j] ? onFlag : (int8_t)-onFlag;
+    return s;
+}
+
+// Signs in {+1,-1}; optional global negation
+vector<int8_t> evalSigns(const DPFKey& key, u64 N, bool negateThisParty) {
+    return toSigns(evalFlagsFull(key, N), negateThisParty);
+}
+
+vector<int8_t> evalSigns(const DPFKey& key, u64 N, bool negateThisParty, WorkStealingPool& pool) {
+    return toSigns(evalFlagsFull(key, N, pool), negateThisParty);
+}
+
+vector<int8_t> evalSignsRange(const DPFKey& key, u64 N, u64 lo, u64 hi, bool negateThisParty) {
+    return toSigns(evalFlagsRange(key, N, lo, hi), negateThisParty);
+}
+
+// ---------------------------------------------------------------------------
+// Lock-step multi-key evaluation.
+// Keys are processed in groups of 8 lanes: the 8 seeds of a node sit in one
+// 512-bit register (or two 256-bit ones) and the 8 flags in one byte, so seed
+// expansion, flag correction and correction-word application are done for all
+// lanes at once.
+// ---------------------------------------------------------------------------
+static const int kLanes = 8;
+
+// per-level correction data for one group of 8 keys
+struct laneCW {
+    alignas(64) u64 cw[kLanes];
+    uint8_t leftAdvice, rightAdvice;
+};
+
+// Expands 8 parent seeds and applies the correction word on the lanes whose
+// parent flag is set. Outputs: child seeds and child flag masks.
+typedef void (*expandLanesFn)(const u64* seeds, uint8_t flags, const laneCW& cw,
+                              u64* left, u64* right, uint8_t& leftFlags, uint8_t& rightFlags);
+
+static void expandLanesScalar(const u64* seeds, uint8_t flags, const laneCW& cw,
+                              u64* left, u64* right, uint8_t& leftFlags, uint8_t& rightFlags) {
+    uint8_t lf = 0, rf = 0;
+    for (int i = 0; i < kLanes; ++i) {
+        child ns = Expand(seeds[i]);
+        u64 mask = 0ULL - (u64)((flags >> i) & 1);
+        left[i]  = ns.leftSeed  ^ (cw.cw[i] & mask);
+        right[i] = ns.rightSeed ^ (cw.cw[i] & mask);
+        lf |= (uint8_t)(ns.leftFlag << i);
+        rf |= (uint8_t)(ns.rightFlag << i);
+    }
+    leftFlags  = lf ^ (flags & cw.leftAdvice);
+    rightFlags = rf ^ (flags & cw.rightAdvice);
+}
+
+#ifdef DPF_HAVE_AESNI
+// GCC's unmasked _mm512_unpack*/_mm512_broadcast_i32x4 merge into an
+// _mm512_undefined_epi32() source, which -Wall reports as maybe-uninitialized.
+// The all-lanes zero-masked forms start from _mm512_setzero_si512() and compile
+// to the same instructions.
+__attribute__((target("avx512f")))
+static inline __m512i unpackLo64(__m512i a, __m512i b) { return _mm512_maskz_unpacklo_epi64(0xFF, a, b); }
+__attribute__((target("avx512f")))
+static inline __m512i unpackHi64(__m512i a, __m512i b) { return _mm512_maskz_unpackhi_epi64(0xFF, a, b); }
+__attribute__((target("avx512f")))
+static inline __m512i broadcast128(__m128i k) { return _mm512_maskz_broadcast_i32x4(0xFFFF, k); }
+
+// AVX-512 + VAES: four AES blocks per instruction, 16 blocks per group
+__attribute__((target("avx512f,vaes")))
+static void expandLanesAVX512(const u64* seeds, uint8_t flags, const laneCW& cw,
+                              u64* left, u64* right, uint8_t& leftFlags, uint8_t& rightFlags) {
+    const AESPRG::RoundKeys& rk = AESPRG::roundKeys();
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one  = _mm512_set1_epi64(1);
+    __m512i s = _mm512_loadu_si512(seeds);
+
+    // blocks (seed,0) are the left children, (seed,1) the right ones;
+    // x[0]/x[1] hold the even/odd lanes of the left blocks, x[2]/x[3] the right
+    __m512i x[4] = { unpackLo64(s, zero), unpackHi64(s, zero),
+                     unpackLo64(s, one),  unpackHi64(s, one) };
+    __m512i y[4];
+    __m512i key = broadcast128(rk.k[0]);
+    for (int b = 0; b < 4; ++b) y[b] = _mm512_xor_si512(x[b], key);
+    for (int r = 1; r < 10; ++r) {
+        key = broadcast128(rk.k[r]);
+        for (int b = 0; b < 4; ++b) y[b] = _mm512_aesenc_epi128(y[b], key);
+    }
+    key = broadcast128(rk.k[10]);
+    for (int b = 0; b < 4; ++b) y[b] = _mm512_xor_si512(_mm512_aesenclast_epi128(y[b], key), x[b]);
+
+    // back to lane order: low words are the seeds, bit 0 of the high words the flags
+    __m512i cwv = _mm512_load_si512(cw.cw);
+    __m512i l = unpackLo64(y[0], y[1]);
+    __m512i r = unpackLo64(y[2], y[3]);
+    l = _mm512_mask_xor_epi64(l, flags, l, cwv);
+    r = _mm512_mask_xor_epi64(r, flags, r, cwv);
+    _mm512_storeu_si512(left, l);
+    _mm512_storeu_si512(right, r);
+    uint8_t lf = _mm512_test_epi64_mask(unpackHi64(y[0], y[1]), one);
+    uint8_t rf = _mm512_test_epi64_mask(unpackHi64(y[2], y[3]), one);
+    leftFlags  = lf ^ (flags & cw.leftAdvice);
+    rightFlags = rf ^ (flags & cw.rightAdvice);
+}
 
-        if(pathBit){
-            lSeed = ns0.rightSeed; lFlag = ns0.rightFlag;
-            rSeed = ns1.rightSeed; rFlag = ns1.rightFlag;
-        }else{
-            lSeed = ns0.leftSeed;  lFlag = ns0.leftFlag;
-            rSeed = ns1.leftSeed;  rFlag = ns1.leftFlag;
+// AVX2 + VAES: two AES blocks per instruction, the group is handled as two halves of 4 lanes
+__attribute__((target("avx2,vaes")))
+static void expandLanesAVX2(const u64* seeds, uint8_t flags, const laneCW& cw,
+                            u64* left, u64* right, uint8_t& leftFlags, uint8_t& rightFlags) {
+    const AESPRG::RoundKeys& rk = AESPRG::roundKeys();
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi64x(1);
+    const __m256i bit  = _mm256_set_epi64x(8, 4, 2, 1);
+    uint8_t lf = 0, rf = 0;
+    for (int h = 0; h < 2; ++h) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(seeds + 4*h));
+        __m256i x[4] = { _mm256_unpacklo_epi64(s, zero), _mm256_unpackhi_epi64(s, zero),
+                         _mm256_unpacklo_epi64(s, one),  _mm256_unpackhi_epi64(s, one) };
+        __m256i y[4];
+        __m256i key = _mm256_broadcastsi128_si256(rk.k[0]);
+        for (int b = 0; b < 4; ++b) y[b] = _mm256_xor_si256(x[b], key);
+        for (int r = 1; r < 10; ++r) {
+            key = _mm256_broadcastsi128_si256(rk.k[r]);
+            for (int b = 0; b < 4; ++b) y[b] = _mm256_aesenc_epi128(y[b], key);
         }
+        key = _mm256_broadcastsi128_si256(rk.k[10]);
+        for (int b = 0; b < 4; ++b) y[b] = _mm256_xor_si256(_mm256_aesenclast_epi128(y[b], key), x[b]);
+
+        // lanes whose parent flag is set get the correction word
+        __m256i fv = _mm256_set1_epi64x((flags >> (4*h)) & 0xF);
+        __m256i mask = _mm256_cmpeq_epi64(_mm256_and_si256(fv, bit), bit);
+        __m256i cwv = _mm256_and_si256(_mm256_load_si256((const __m256i*)(cw.cw + 4*h)), mask);
+        _mm256_storeu_si256((__m256i*)(left + 4*h),  _mm256_xor_si256(_mm256_unpacklo_epi64(y[0], y[1]), cwv));
+        _mm256_storeu_si256((__m256i*)(right + 4*h), _mm256_xor_si256(_mm256_unpacklo_epi64(y[2], y[3]), cwv));
 
-        correctionWord cw = {correction_word, leftAdvice, rightAdvice};
-        k0.cw_s[level] = cw;
-        k1.cw_s[level] = cw;
+        __m256i lh = _mm256_slli_epi64(_mm256_unpackhi_epi64(y[0], y[1]), 63);
+        __m256i rh = _mm256_slli_epi64(_mm256_unpackhi_epi64(y[2], y[3]), 63);
+        lf |= (uint8_t)(_mm256_movemask_pd(_mm256_castsi256_pd(lh)) << (4*h));
+        rf |= (uint8_t)(_mm256_movemask_pd(_mm256_castsi256_pd(rh)) << (4*h));
     }
+    leftFlags  = lf ^ (flags & cw.leftAdvice);
+    rightFlags = rf ^ (flags & cw.rightAdvice);
+}
+#endif
 
-    // Final CW for zero payload
-    u64 final_correctionWord = (lSeed ^ rSeed) ^ value;
+// picks the widest kernel this CPU supports (only the AES backend has vector kernels)
+static expandLanesFn selectLanesKernel() {
+#ifdef DPF_HAVE_AESNI
+    if (std::is_same<DefaultPRG, AESPRG>::value) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vaes")) return expandLanesAVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("vaes")) return expandLanesAVX2;
+    }
+#endif
+    return expandLanesScalar;
+}
 
-    // Split additively mod p so FCW0 + FCW1 = 0 (so Step 3 yields FCWm = M)
-    ll r = (ll)(rd() % mod);
-    k0.final_cw =  r;
-    k1.final_cw = norm(-r);
+// Lane-packed key data: per-level correction words for every lane group
+struct laneKeys {
+    size_t L, G;                 // keys, groups of kLanes (padding lanes repeat key 0)
+    u64 depth, shift;
+    vector<const DPFKey*> keys;  // L, for the leaf correction words
+    vector<laneCW> cws;          // depth * G, level-major
+    vector<u64> rootSeeds;       // G * kLanes
+    vector<uint8_t> rootFlags;   // G
+};
 
-    return {k0, k1};
+static laneKeys packLanes(const vector<const DPFKey*>& keys, u64 N) {
+    if (keys.size() > kMaxBatchKeys) throw runtime_error("evalFlagsFullBatch: at most 16 keys per batch");
+    laneKeys lk;
+    lk.depth = treeDepth(N);
+    lk.shift = leafShift(N);
+    lk.keys = keys;
+    for (const DPFKey* k : keys)
+        if (k->cw_s.size() != lk.depth) throw runtime_error("evalFlagsFullBatch: key depth does not match N");
+    lk.L = keys.size();
+    lk.G = (lk.L + kLanes - 1) / kLanes;
+    auto laneKey = [&](size_t lane) -> const DPFKey& { return *keys[lane < lk.L ? lane : 0]; };
+
+    lk.rootSeeds.resize(lk.G * kLanes);
+    lk.rootFlags.assign(lk.G, 0);
+    for (size_t lane = 0; lane < lk.G * kLanes; ++lane) {
+        lk.rootSeeds[lane] = laneKey(lane).seed;
+        lk.rootFlags[lane / kLanes] |= (uint8_t)(laneKey(lane).t0 << (lane % kLanes));
+    }
+    lk.cws.resize(lk.depth * lk.G);
+    for (u64 level = 0; level < lk.depth; ++level) {
+        for (size_t g = 0; g < lk.G; ++g) {
+            laneCW& c = lk.cws[level * lk.G + g];
+            c.leftAdvice = c.rightAdvice = 0;
+            for (int i = 0; i < kLanes; ++i) {
+                const correctionWord& cw = laneKey(g * kLanes + i).cw_s[level];
+                c.cw[i] = cw.cw;
+                c.leftAdvice  |= (uint8_t)(cw.leftAdviceBit << i);
+                c.rightAdvice |= (uint8_t)(cw.rightAdviceBit << i);
+            }
+        }
+    }
+    return lk;
 }
 
-// Return the leaf flag at a location
-bool evalFlagAt(const DPFKey& key, u64 location, u64 N) {
-    u64 depth = N<=1?0:(int)ceil(log2(N));
-    u64 currSeed = key.seed;
-    bool currentFlag = key.t0;
-    for (u64 level = 0; level < depth; ++level) {
-        bool pathBit = ((location >> (depth - 1 - level)) & 1ULL);
-        child ns0 = Expand(currSeed, level);
-        if (currentFlag) {
-            ns0.leftSeed  ^= key.cw_s[level].cw;
-            ns0.rightSeed ^= key.cw_s[level].cw;
-            ns0.leftFlag  ^= key.cw_s[level].leftAdviceBit;
-            ns0.rightFlag ^= key.cw_s[level].rightAdviceBit;
+// Lane-packed counterpart of expandDown. Node-major layout: the G*8 seeds of a
+// node are contiguous, one flag byte per group. Both children are always
+// written, so buffers are sized once for the widest level plus one node.
+static void expandDownLanes(const laneKeys& lk, u64 level, u64 leaves, u64 steps,
+                            vector<u64>& seeds, vector<uint8_t>& flags) {
+    static const expandLanesFn expandLanes = selectLanesKernel();
+    const size_t G = lk.G;
+    u64 finalWidth = nodesCovering(leaves, lk.depth - level - steps);
+    u64 parents = flags.size() / G;
+    seeds.resize((finalWidth + 1) * G * kLanes);
+    flags.resize((finalWidth + 1) * G);
+    vector<u64> nextSeeds(seeds.size());
+    vector<uint8_t> nextFlags(flags.size());
+
+    for (u64 l = level; l < level + steps; ++l) {
+        const laneCW* cws = &lk.cws[l * G];
+        for (u64 p = 0; p < parents; ++p) {
+            for (size_t g = 0; g < G; ++g) {
+                expandLanes(&seeds[(p * G + g) * kLanes], flags[p * G + g], cws[g],
+                            &nextSeeds[(2*p * G + g) * kLanes], &nextSeeds[((2*p + 1) * G + g) * kLanes],
+                            nextFlags[2*p * G + g], nextFlags[(2*p + 1) * G + g]);
+            }
         }
-        if (pathBit){
-            currSeed = ns0.rightSeed;
-            currentFlag = ns0.rightFlag;
-        }else{
-            currSeed = ns0.leftSeed;
-            currentFlag = ns0.leftFlag;
+        seeds.swap(nextSeeds);
+        flags.swap(nextFlags);
+        parents = nodesCovering(leaves, lk.depth - 1 - l);
+    }
+    seeds.resize(parents * G * kLanes);
+    flags.resize(parents * G);
+}
+
+// converts `count` leaf blocks starting at block `first` out of the lane layout
+// into location flags (locations past N are dropped)
+static void unpackLanes(const laneKeys& lk, const vector<u64>& seeds, const vector<uint8_t>& flags,
+                        u64 first, u64 count, u64 N, vector<vector<uint8_t>>& out) {
+    for (u64 x = 0; x < count; ++x) {
+        u64 loc = (first + x) << lk.shift;
+        u64 take = min<u64>(N - loc, 1ULL << lk.shift);
+        for (size_t lane = 0; lane < lk.L; ++lane) {
+            size_t g = lane / kLanes, i = lane % kLanes;
+            leafFlags(*lk.keys[lane], seeds[(x * lk.G + g) * kLanes + i], (flags[x * lk.G + g] >> i) & 1,
+                      0, take, &out[lane][loc]);
         }
     }
-    return currentFlag;
 }
 
-// Signs in {+1,-1}; optional global negation
-vector<int8_t> evalSigns(const DPFKey& key, u64 N, bool negateThisParty) {
-    vector<int8_t> s(N, 0);
-    for (u64 j = 0; j < N; ++j) {
-        int v = evalFlagAt(key, j, N) ? -1 : 1;
-        if (negateThisParty) v = -v;
-        s[j] = (int8_t)v;
+// Leaf flags of up to 16 keys over the same domain [0,N), evaluated in lock step.
+vector<vector<uint8_t>> evalFlagsFullBatch(const vector<const DPFKey*>& keys, u64 N) {
+    if (keys.empty()) return {};
+    laneKeys lk = packLanes(keys, N);
+    u64 blocks = nodesCovering(N, lk.shift);
+    vector<u64> seeds = lk.rootSeeds;
+    vector<uint8_t> flags = lk.rootFlags;
+    expandDownLanes(lk, 0, blocks, lk.depth, seeds, flags);
+
+    vector<vector<uint8_t>> out(lk.L, vector<uint8_t>(N));
+    unpackLanes(lk, seeds, flags, 0, blocks, N, out);
+    return out;
+}
+
+// Lock-step evaluation split into subtrees on the pool, as in evalFlagsFull(key, N, pool)
+vector<vector<uint8_t>> evalFlagsFullBatch(const vector<const DPFKey*>& keys, u64 N, WorkStealingPool& pool) {
+    if (pool.size() == 1 || N < kMinParallelLeaves) return evalFlagsFullBatch(keys, N);
+    if (keys.empty()) return {};
+    laneKeys lk = packLanes(keys, N);
+    u64 blocks = nodesCovering(N, lk.shift);
+    u64 top = splitLevel(lk.depth, pool.size());
+    u64 h = lk.depth - top;
+
+    vector<u64> roots = lk.rootSeeds;
+    vector<uint8_t> rootFlags = lk.rootFlags;
+    expandDownLanes(lk, 0, blocks, top, roots, rootFlags);
+
+    vector<vector<uint8_t>> out(lk.L, vector<uint8_t>(N));
+    vector<function<void()>> tasks;
+    for (u64 i = 0; i < rootFlags.size() / lk.G; ++i) {
+        tasks.push_back([&, i] {
+            u64 first = i << h;
+            u64 leaves = min<u64>(blocks, first + (1ULL << h)) - first;
+            vector<u64> seeds(roots.begin() + i * lk.G * kLanes, roots.begin() + (i + 1) * lk.G * kLanes);
+            vector<uint8_t> flags(rootFlags.begin() + i * lk.G, rootFlags.begin() + (i + 1) * lk.G);
+            expandDownLanes(lk, top, leaves, h, seeds, flags);
+            unpackLanes(lk, seeds, flags, first, leaves, N, out);
+        });
     }
+    pool.run(tasks);
+    return out;
+}
+
+// Signs of up to 16 keys at once; negateThisParty[i] applies to keys[i]
+vector<vector<int8_t>> evalSignsBatch(const vector<const DPFKey*>& keys, u64 N,
+                                      const vector<bool>& negateThisParty) {
+    vector<vector<uint8_t>> flags = evalFlagsFullBatch(keys, N);
+    vector<vector<int8_t>> s(flags.size());
+    for (size_t i = 0; i < flags.size(); ++i) s[i] = toSigns(flags[i], negateThisParty[i]);
     return s;
 }
 
-// Serialization (one line per key)
-void writeKey(ostream& out, const DPFKey& k) {
-    int depth = (int)k.cw_s.size();
-    out << depth << " " << k.seed << " " << (int)k.t0 << " " << norm(k.final_cw);
-    for (int i = 0; i < depth; ++i) {
-        out << " " << k.cw_s[i].cw << " " << (int)k.cw_s[i].leftAdviceBit
-            << " " << (int)k.cw_s[i].rightAdviceBit;
-    }
-    out << "\n";
+vector<vector<int8_t>> evalSignsBatch(const vector<const DPFKey*>& keys, u64 N,
+                                      const vector<bool>& negateThisParty, WorkStealingPool& pool) {
+    vector<vector<uint8_t>> flags = evalFlagsFullBatch(keys, N, pool);
+    vector<vector<int8_t>> s(flags.size());
+    for (size_t i = 0; i < flags.size(); ++i) s[i] = toSigns(flags[i], negateThisParty[i]);
+    return s;
 }
 
-DPFKey readKey(istream& in) {
-    int depth; u64 seed; int t0i; long long fcw;
-    if (!(in >> depth >> seed >> t0i >> fcw)) throw runtime_error("Malformed DPF key");
-    DPFKey k(depth);
-    k.seed = seed;
-    k.t0 = (t0i != 0);
-    k.final_cw = norm(fcw);
-    for (int i = 0; i < depth; ++i) {
-        unsigned long long cw; int l, r;
-        if (!(in >> cw >> l >> r)) throw runtime_error("Malformed DPF CW entries");
-        k.cw_s[i] = correctionWord{(u64)cw, (bool)l, (bool)r};
+DPFLeafStream::DPFLeafStream(const DPFKey& k, u64 n, u64 blockSize) : key(k), N(n) {
+    if (blockSize == 0 || (blockSize & (blockSize - 1)))
+        throw invalid_argument("DPFLeafStream: block size must be a power of two");
+    depth = treeDepth(N);
+    shift = leafShift(N);
+    h = 0;
+    while ((1ULL << (h + shift)) < blockSize && h < depth) ++h;  // tree levels expanded inside a block
+    top = depth - h;                                               // level of the block roots
+    blocks = nodesCovering(nodesCovering(N, shift), h);
+    path.resize(top);
+}
+
+bool DPFLeafStream::next() {
+    if (nextBlock >= blocks) return false;
+    u64 b = nextBlock++;
+
+    // the level-l node on the path is b >> (top - l); only the levels below the
+    // highest bit that changed from b-1 need to be expanded again
+    u64 start = 0;
+    if (b > 0) start = top - (63 - __builtin_clzll(b ^ (b - 1)));
+    for (u64 l = start; l < top; ++l) {
+        u64 seed = key.seed;
+        bool flag = key.t0;
+        if (l > 0) {
+            bool bit = (b >> (top - l)) & 1;
+            seed = bit ? path[l-1].rightSeed : path[l-1].leftSeed;
+            flag = bit ? path[l-1].rightFlag : path[l-1].leftFlag;
+        }
+        path[l] = FlagDPF::expandNode(key, l, seed, flag);
     }
-    return k;
+
+    blockSeeds.assign(1, key.seed);
+    nodeFlags.assign(1, key.t0);
+    if (top > 0) {
+        bool bit = b & 1;
+        blockSeeds[0] = bit ? path[top-1].rightSeed : path[top-1].leftSeed;
+        nodeFlags[0] = bit ? path[top-1].rightFlag : path[top-1].leftFlag;
+    }
+    blockFirst = (b << h) << shift;
+    u64 count = min<u64>(N - blockFirst, 1ULL << (h + shift));
+    expandDown(key, depth, top, nodesCovering(count, shift), h, blockSeeds, nodeFlags);
+    blockFlags.resize(count);
+    convertLeaves(key, shift, blockSeeds, nodeFlags, 0, count, blockFlags.data());
+    return true;
+}
+
+const int8_t* DPFLeafStream::signs(bool negateThisParty) {
+    int8_t onFlag = negateThisParty ? 1 : -1;
+    blockSigns.resize(blockFlags.size());
+    for (size_t j = 0; j < blockFlags.size(); ++j) blockSigns[j] = blockFlags[j] ? onFlag : (int8_t)-onFlag;
+    return blockSigns.data();
+}
+
+// Callback form of DPFLeafStream: consume(first, signs, count) once per block
+void evalSignsStream(const DPFKey& key, u64 N, bool negateThisParty, u64 blockSize,
+                     const function<void(u64, const int8_t*, u64)>& consume) {
+    DPFLeafStream stream(key, N, blockSize);
+    while (stream.next()) consume(stream.first(), stream.signs(negateThisParty), stream.count());
 }
 
 ll DPF_getFinalCW(const DPFKey& k) { return norm(k.final_cw); }
\ No newline at end of file
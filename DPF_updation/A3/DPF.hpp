@@ -1,37 +1,89 @@
 #pragma once
 #include <cstdint>
 #include <vector>
-#include <iosfwd>
+#include <functional>
+#include "dpf_core.hpp"
+
+class WorkStealingPool;
 
 using u64 = uint64_t;
 using ll  = long long;
 
-struct correctionWord {
-    u64 cw;
-    bool leftAdviceBit, rightAdviceBit;
-};
+// The sign vectors come from a flag DPF: GF(2) outputs, e_j at the selected item.
+// Early termination: the GGM tree stops kLeafLevels above the locations and each
+// of its leaves is a seed that converts into 2^kLeafLevels = 128 location flags.
+using FlagDPF = GGMDPF<DefaultPRG, BitGroup>;
+const u64 kLeafLevels = BitGroup::kLeafLevels;
 
-class DPFKey {
+// seed, t0, cw_s (one per GGM level) and the 128-bit leaf_cw come from FlagDPF::Key
+class DPFKey : public FlagDPF::Key {
 public:
-    u64 seed{};
-    bool t0{};
-    std::vector<correctionWord> cw_s;
-    ll final_cw{}; // additive share mod p
+    ll final_cw{}; // additive share in the ring (ring.hpp)
 
     DPFKey() = default;
     explicit DPFKey(int depth);
 };
 
+// number of GGM levels (cw_s entries) in a key over [0,N)
+u64 dpfTreeDepth(u64 N);
+
 // Generation with zero payload at target (user side)
 std::pair<DPFKey, DPFKey> generateDPF(u64 location, u64 value, u64 N);
 
 // Flag/sign evaluation helpers
 bool evalFlagAt(const DPFKey& key, u64 location, u64 N);
+std::vector<uint8_t> evalFlagsFull(const DPFKey& key, u64 N);
 std::vector<int8_t> evalSigns(const DPFKey& key, u64 N, bool negateThisParty);
 
-// Serialization (one key per line)
-void writeKey(std::ostream& out, const DPFKey& k);
-DPFKey readKey(std::istream& in);
+// Range-restricted evaluation of [lo, hi): O((hi - lo) + log N) PRG calls, so a
+// shard owning a contiguous slice of the items only pays for its own slice
+std::vector<uint8_t> evalFlagsRange(const DPFKey& key, u64 N, u64 lo, u64 hi);
+std::vector<int8_t> evalSignsRange(const DPFKey& key, u64 N, u64 lo, u64 hi, bool negateThisParty);
+
+// Lock-step (SIMD) evaluation of several keys over the same domain; one vector per key
+const size_t kMaxBatchKeys = 16;
+std::vector<std::vector<uint8_t>> evalFlagsFullBatch(const std::vector<const DPFKey*>& keys, u64 N);
+std::vector<std::vector<int8_t>> evalSignsBatch(const std::vector<const DPFKey*>& keys, u64 N,
+                                                const std::vector<bool>& negateThisParty);
+
+// Multithreaded variants: top levels expanded serially, disjoint subtrees on the pool.
+// Output is identical to the serial functions above.
+std::vector<uint8_t> evalFlagsFull(const DPFKey& key, u64 N, WorkStealingPool& pool);
+std::vector<int8_t> evalSigns(const DPFKey& key, u64 N, bool negateThisParty, WorkStealingPool& pool);
+std::vector<std::vector<uint8_t>> evalFlagsFullBatch(const std::vector<const DPFKey*>& keys, u64 N,
+                                                     WorkStealingPool& pool);
+std::vector<std::vector<int8_t>> evalSignsBatch(const std::vector<const DPFKey*>& keys, u64 N,
+                                                const std::vector<bool>& negateThisParty,
+                                                WorkStealingPool& pool);
+
+// Streaming evaluation with O(log N) tree state: leaves come out left to right in
+// blocks of blockSize (a power of two; at least one 128-location leaf block). Only the expanded children along the path
+// to the current block are kept, so every internal node is still expanded once.
+const u64 kDPFStreamBlock = 1ULL << 16;
+
+class DPFLeafStream {
+public:
+    DPFLeafStream(const DPFKey& key, u64 N, u64 blockSize = kDPFStreamBlock);
+
+    bool next();    // evaluates the next block; false once [0,N) is exhausted
+    u64 first() const { return blockFirst; }
+    u64 count() const { return blockFlags.size(); }
+    const uint8_t* flags() const { return blockFlags.data(); }
+    const int8_t* signs(bool negateThisParty);  // current block as {+1,-1}
+
+private:
+    const DPFKey& key;
+    u64 N, depth, shift, top, h, blocks, nextBlock = 0;
+    std::vector<child> path;    // path[l]: corrected children of the level-l node on the path
+    u64 blockFirst = 0;
+    std::vector<u64> blockSeeds;
+    std::vector<uint8_t> nodeFlags;     // flags of blockSeeds
+    std::vector<uint8_t> blockFlags;    // location flags of the current block
+    std::vector<int8_t> blockSigns;
+};
+
+void evalSignsStream(const DPFKey& key, u64 N, bool negateThisParty, u64 blockSize,
+                     const std::function<void(u64 first, const int8_t* signs, u64 count)>& consume);
 
 // Accessor for final_cw
 ll DPF_getFinalCW(const DPFKey& k);
\ No newline at end of file
@@ -0,0 +1,277 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "prg.hpp"
+
+// Shared GGM-tree DPF, specialised at compile time over the PRG backend and the
+// output group. Used by DPF_updation/A3 (flag outputs for the sign vectors) and by
+// DPF_Generation (64-bit payloads).
+//
+// The tree is early-terminated: a group packs 2^kLeafLevels elements into one
+// 128-bit leaf block, so the GGM tree stops that many levels above the locations
+// and location x reads element x mod 2^kLeafLevels of its leaf block.
+// Seeds are 64 bits wide, the width both PRG backends expand.
+
+// structure to hold the correction word and the advice bits for a level
+struct correctionWord {
+    u64 cw;
+    bool leftAdviceBit, rightAdviceBit;
+};
+
+// 128 output bits of a leaf seed, interpreted by the group
+struct leafBlock {
+    u64 w[2];
+};
+
+// GF(2) with one bit per location: 128 locations per leaf block
+struct BitGroup {
+    using value_type = uint8_t;
+    static constexpr u64 kLeafLevels = 7;
+
+    static leafBlock fromBits(const u64 w[2]) { return {{w[0], w[1]}}; }
+    static leafBlock add(const leafBlock& a, const leafBlock& b) { return {{a.w[0] ^ b.w[0], a.w[1] ^ b.w[1]}}; }
+    static leafBlock sub(const leafBlock& a, const leafBlock& b) { return add(a, b); }
+    static leafBlock neg(const leafBlock& a) { return a; }
+    static leafBlock unit(u64 j, value_type v) {
+        leafBlock b{};
+        b.w[j >> 6] = (u64)(v & 1) << (j & 63);
+        return b;
+    }
+    static value_type element(const leafBlock& b, u64 j) { return (b.w[j >> 6] >> (j & 63)) & 1; }
+};
+
+// Two 64-bit elements per leaf block; Op supplies the element arithmetic
+template <typename Op>
+struct WordGroup {
+    using value_type = u64;
+    static constexpr u64 kLeafLevels = 1;
+
+    static leafBlock fromBits(const u64 w[2]) { return {{Op::reduce(w[0]), Op::reduce(w[1])}}; }
+    static leafBlock add(const leafBlock& a, const leafBlock& b) { return {{Op::add(a.w[0], b.w[0]), Op::add(a.w[1], b.w[1])}}; }
+    static leafBlock sub(const leafBlock& a, const leafBlock& b) { return add(a, neg(b)); }
+    static leafBlock neg(const leafBlock& a) { return {{Op::neg(a.w[0]), Op::neg(a.w[1])}}; }
+    static leafBlock unit(u64 j, value_type v) {
+        leafBlock b{};
+        b.w[j] = Op::reduce(v);
+        return b;
+    }
+    static value_type element(const leafBlock& b, u64 j) { return b.w[j]; }
+};
+
+// GF(2)^64: XOR shares
+struct XorOp {
+    static u64 reduce(u64 a) { return a; }
+    static u64 add(u64 a, u64 b) { return a ^ b; }
+    static u64 neg(u64 a) { return a; }
+};
+
+// Z_{2^64}: wrap-around arithmetic
+struct Z2k64Op {
+    static u64 reduce(u64 a) { return a; }
+    static u64 add(u64 a, u64 b) { return a + b; }
+    static u64 neg(u64 a) { return 0 - a; }
+};
+
+// Z_p for a prime p < 2^63
+template <u64 P>
+struct ZpOp {
+    static u64 reduce(u64 a) { return a % P; }
+    static u64 add(u64 a, u64 b) {
+        u64 s = a + b;
+        return s >= P ? s - P : s;
+    }
+    static u64 neg(u64 a) { return a == 0 ? 0 : P - a; }
+};
+
+using Xor64Group = WordGroup<XorOp>;
+using Z2k64Group = WordGroup<Z2k64Op>;
+using Zp1e9Group = WordGroup<ZpOp<1000000007ULL>>;
+
+template <typename PRG, typename Group>
+struct GGMDPF {
+    using value_type = typename Group::value_type;
+
+    // Party 0 holds the key with root flag t0 = 1. Both keys carry the same
+    // correction words; party 1 negates its output in groups where that matters.
+    struct Key {
+        u64 seed{};
+        bool t0{};
+        std::vector<correctionWord> cw_s;   // one per GGM level
+        leafBlock leaf_cw{};                 // correction of the leaf block on the path
+    };
+
+    // number of levels needed to address [0,N)
+    static u64 domainBits(u64 N) {
+        return N <= 1 ? 0 : (u64)std::ceil(std::log2((double)N));
+    }
+
+    // levels folded into each leaf block (fewer when N itself is smaller than a block)
+    static u64 leafShift(u64 N) {
+        u64 bits = domainBits(N);
+        return bits < Group::kLeafLevels ? bits : Group::kLeafLevels;
+    }
+
+    // depth of the GGM tree covering [0,N); its leaves are leaf blocks, not locations
+    static u64 treeDepth(u64 N) {
+        return domainBits(N) - leafShift(N);
+    }
+
+    // Number of nodes `h` levels above the leaves that cover one of the first `leaves` leaves
+    static u64 nodesCovering(u64 leaves, u64 h) {
+        return (leaves + (1ULL << h) - 1) >> h;
+    }
+
+    // children of a node on `level`, corrected where the node's flag is 1
+    static child expandNode(const Key& key, u64 level, u64 seed, bool flag) {
+        child ns = PRG::expand(seed);
+        if (flag) {
+            const correctionWord& cw = key.cw_s[level];
+            ns.leftSeed  ^= cw.cw;
+            ns.rightSeed ^= cw.cw;
+            ns.leftFlag  ^= cw.leftAdviceBit;
+            ns.rightFlag ^= cw.rightAdviceBit;
+        }
+        return ns;
+    }
+
+    static leafBlock convert(u64 seed) {
+        u64 w[2];
+        PRG::convert(seed, w);
+        return Group::fromBits(w);
+    }
+
+    // this party's share of the leaf block held by (seed, flag)
+    static leafBlock leafOutput(const Key& key, u64 seed, bool flag) {
+        leafBlock b = convert(seed);
+        if (flag) b = Group::add(b, key.leaf_cw);
+        return key.t0 ? b : Group::neg(b);
+    }
+
+    // Keys for the point function value at location, zero elsewhere; seed0/seed1
+    // are the (random) root seeds of the two parties
+    static std::pair<Key, Key> generate(u64 location, value_type value, u64 N, u64 seed0, u64 seed1) {
+        if (location >= N) throw std::runtime_error("location must in [0,N)");
+        u64 depth = treeDepth(N);
+        u64 shift = leafShift(N);
+        u64 block = location >> shift;
+
+        Key k0, k1;
+        k0.seed = seed0;
+        k1.seed = seed1;
+        k0.t0 = 1;
+        k1.t0 = 0;
+        k0.cw_s.resize(depth);
+        k1.cw_s.resize(depth);
+
+        u64 lSeed = k0.seed, rSeed = k1.seed;
+        bool lFlag = k0.t0,   rFlag = k1.t0;
+
+        for (u64 level = 0; level < depth; level++) {
+            bool pathBit = (block & (1ULL << (depth - 1 - level)));
+            child ns0 = PRG::expand(lSeed);
+            child ns1 = PRG::expand(rSeed);
+
+            u64 correction_word;
+            bool leftAdvice  = (ns0.leftFlag  ^ ns1.leftFlag  ^ (pathBit == 0));
+            bool rightAdvice = (ns0.rightFlag ^ ns1.rightFlag ^ (pathBit == 1));
+
+            if (pathBit) {
+                correction_word = ns0.leftSeed ^ ns1.leftSeed;
+            } else {
+                correction_word = ns0.rightSeed ^ ns1.rightSeed;
+            }
+
+            if (lFlag) {
+                ns0.leftSeed  ^= correction_word;
+                ns0.leftFlag  ^= leftAdvice;
+                ns0.rightSeed ^= correction_word;
+                ns0.rightFlag ^= rightAdvice;
+            } else {
+                ns1.leftSeed  ^= correction_word;
+                ns1.leftFlag  ^= leftAdvice;
+                ns1.rightSeed ^= correction_word;
+                ns1.rightFlag ^= rightAdvice;
+            }
+
+            if (pathBit) {
+                lSeed = ns0.rightSeed; lFlag = ns0.rightFlag;
+                rSeed = ns1.rightSeed; rFlag = ns1.rightFlag;
+            } else {
+                lSeed = ns0.leftSeed;  lFlag = ns0.leftFlag;
+                rSeed = ns1.leftSeed;  rFlag = ns1.leftFlag;
+            }
+
+            correctionWord cw = {correction_word, leftAdvice, rightAdvice};
+            k0.cw_s[level] = cw;
+            k1.cw_s[level] = cw;
+        }
+
+        // Leaf CW: on the path exactly one party applies it, so the shares of the
+        // leaf block add up to value at the location (party 1 subtracts its share):
+        // CW = (-1)^rFlag * (value*e_pos - G(s0) + G(s1)). Off the path the seeds
+        // and flags agree and the shares cancel.
+        leafBlock cw = Group::add(Group::sub(Group::unit(location & ((1ULL << shift) - 1), value),
+                                             convert(lSeed)),
+                                  convert(rSeed));
+        if (rFlag) cw = Group::neg(cw);
+        k0.leaf_cw = cw;
+        k1.leaf_cw = cw;
+        return {k0, k1};
+    }
+
+    // this party's share of the output at one location: O(log N) PRG calls
+    static value_type evalAt(const Key& key, u64 location, u64 N) {
+        u64 depth = treeDepth(N);
+        u64 shift = leafShift(N);
+        u64 block = location >> shift;
+        u64 currSeed = key.seed;
+        bool currentFlag = key.t0;
+        for (u64 level = 0; level < depth; ++level) {
+            bool pathBit = ((block >> (depth - 1 - level)) & 1ULL);
+            child ns = expandNode(key, level, currSeed, currentFlag);
+            currSeed = pathBit ? ns.rightSeed : ns.leftSeed;
+            currentFlag = pathBit ? ns.rightFlag : ns.leftFlag;
+        }
+        return Group::element(leafOutput(key, currSeed, currentFlag), location & ((1ULL << shift) - 1));
+    }
+
+    // Shares at all locations in [0,N). The tree is expanded level by level so
+    // every internal node is expanded once and every leaf block converted once;
+    // nodes whose subtree lies entirely past N are never expanded.
+    static std::vector<value_type> evalFull(const Key& key, u64 N) {
+        u64 depth = treeDepth(N);
+        u64 shift = leafShift(N);
+        std::vector<u64> seeds(1, key.seed), nextSeeds;
+        std::vector<uint8_t> flags(1, key.t0), nextFlags;
+        u64 blocks = nodesCovering(N, shift);
+
+        for (u64 level = 0; level < depth; ++level) {
+            u64 width = nodesCovering(blocks, depth - 1 - level);
+            nextSeeds.resize(width);
+            nextFlags.resize(width);
+            for (u64 p = 0; p < seeds.size(); ++p) {
+                child ns = expandNode(key, level, seeds[p], flags[p]);
+                nextSeeds[2*p] = ns.leftSeed;
+                nextFlags[2*p] = ns.leftFlag;
+                if (2*p + 1 < width) {
+                    nextSeeds[2*p + 1] = ns.rightSeed;
+                    nextFlags[2*p + 1] = ns.rightFlag;
+                }
+            }
+            seeds.swap(nextSeeds);
+            flags.swap(nextFlags);
+        }
+
+        std::vector<value_type> out(N);
+        for (u64 b = 0; b < blocks; ++b) {
+            leafBlock leaf = leafOutput(key, seeds[b], flags[b]);
+            u64 first = b << shift;
+            u64 count = (N - first) < (1ULL << shift) ? N - first : (1ULL << shift);
+            for (u64 j = 0; j < count; ++j) out[first + j] = Group::element(leaf, j);
+        }
+        return out;
+    }
+};
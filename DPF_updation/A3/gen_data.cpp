@@ -2,6 +2,9 @@
 #include "utility.hpp"
 #include "common.hpp"
 #include "DPF.hpp"
+#include "key_store.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <stdexcept>
@@ -33,10 +36,58 @@ void generator(const string& prefix, int row, int k) {
     cout << "Generated shares for " << prefix << " matrix." << endl;
 }
 
+// queries handled by one pool task; a wave of chunks is written before the next one starts
+const size_t kKeyChunk = 4096;
+
+// Generates the DPF key pairs for all target locations on the pool. Chunks of
+// kKeyChunk queries are independent tasks that encode their keys straight into
+// binary records; the records are then appended in query order. Returns the
+// global-negation hint of every query.
+vector<uint8_t> generateKeysBulk(const vector<u64>& locations, u64 n, WorkStealingPool& pool,
+                                 DPFKeyWriter& dpf0, DPFKeyWriter& dpf1) {
+    const size_t rec = keyRecordSize(dpfTreeDepth(n));
+    const size_t chunksPerWave = 4 * (size_t)pool.size();
+    vector<uint8_t> negate(locations.size());
+    vector<vector<uint8_t>> rec0(chunksPerWave), rec1(chunksPerWave);
+
+    for (size_t waveStart = 0; waveStart < locations.size(); waveStart += chunksPerWave * kKeyChunk) {
+        vector<function<void()>> tasks;
+        for (size_t c = 0; c < chunksPerWave; ++c) {
+            size_t first = waveStart + c * kKeyChunk;
+            if (first >= locations.size()) break;
+            size_t last = min(locations.size(), first + kKeyChunk);
+            tasks.push_back([&, c, first, last] {
+                rec0[c].resize((last - first) * rec);
+                rec1[c].resize((last - first) * rec);
+                for (size_t q = first; q < last; ++q) {
+                    // User-side DPF generation for the target index with zero payload
+                    auto [k0, k1] = generateDPF(locations[q], /*value=*/0, n);
+                    encodeKeyRecord(k0, &rec0[c][(q - first) * rec]);
+                    encodeKeyRecord(k1, &rec1[c][(q - first) * rec]);
+
+                    // Insecure global-negation bit: choose which party negates to make target positive
+                    int s0_at = evalFlagAt(k0, locations[q], n) ? -1 : 1;
+                    int s1_at = evalFlagAt(k1, locations[q], n) ? -1 : 1;
+                    negate[q] = ((s0_at - s1_at) < 0); // if sum would be -2, flip
+                }
+            });
+        }
+        size_t chunks = tasks.size();
+        pool.run(tasks);
+        for (size_t c = 0; c < chunks; ++c) {
+            dpf0.appendRecords(rec0[c].data(), rec0[c].size() / rec);
+            dpf1.appendRecords(rec1[c].data(), rec1[c].size() / rec);
+        }
+    }
+    return negate;
+}
+
 int main(int argc, char* argv[]) {
     // checks whether the number of arguments is correct
-    if (argc != 5) {
-        cerr << "Usage: " << argv[0] << " <num_users> <num_items> <num_features> <queries>\n";
+    bool bulk = (argc == 6 && string(argv[5]) == "--bulk");
+    if (argc != 5 && !bulk) {
+        cerr << "Usage: " << argv[0] << " <num_users> <num_items> <num_features> <queries> [--bulk]\n"
+             << "  --bulk  skip the one-hot S0/S1 selector shares (O(items) text per query)\n";
         return 1;
     }
 
@@ -61,33 +112,40 @@ int main(int argc, char* argv[]) {
         if (!queries_users.is_open()) {
             throw runtime_error("Could not open queries_users.txt for writing.");
         }
-        ofstream s0f("S0.txt");
-        ofstream s1f("S1.txt");
-        if (!s0f.is_open() || !s1f.is_open()) {
-            throw runtime_error("Could not open S0.txt/S1.txt for writing.");
+        ofstream s0f, s1f;
+        if (!bulk) {
+            s0f.open("S0.txt");
+            s1f.open("S1.txt");
+            if (!s0f.is_open() || !s1f.is_open()) {
+                throw runtime_error("Could not open S0.txt/S1.txt for writing.");
+            }
         }
 
-        // New: DPF key files and negate hint
-        ofstream dpf0("DPF0.txt");
-        ofstream dpf1("DPF1.txt");
+        // New: binary DPF key files (see key_store.hpp) and negate hint
+        DPFKeyWriter dpf0("DPF0.bin", (u64) n);
+        DPFKeyWriter dpf1("DPF1.bin", (u64) n);
         ofstream dneg("DPF_NEG.txt");
-        if (!dpf0.is_open() || !dpf1.is_open() || !dneg.is_open())
-            throw runtime_error("Could not open DPF0.txt/DPF1.txt/DPF_NEG.txt for writing.");
+        if (!dneg.is_open())
+            throw runtime_error("Could not open DPF_NEG.txt for writing.");
 
+        vector<u64> locations;
+        locations.reserve(queries);
         for (int i=0;i<queries;i++) {
             int ui = random_uint32() % m;
             int vj = random_uint32() % n;
 
             // Full query only for the direct updation (just to verify the protocol) This is not used in the MPC protocol it remains secure 
-            queries_file << ui << " " << vj << endl;
+            queries_file << ui << " " << vj << "\n";
 
             // User-only line (for MPC parties)
             queries_users << ui << "\n";
+            locations.push_back((u64) vj);
+            if (bulk) continue;
 
-            // Build one-hot e_j and additive shares s0, s1 mod mod
+            // Build one-hot e_j and additive shares s0, s1 in the ring
             vector<ll> s0(n), s1(n);
             for (int idx = 0; idx < n; ++idx) {
-                ll r = random_uint32() % mod;
+                ll r = (ll)Ring::fromWord(random_uint64());
                 s0[idx] = r;
                 ll e = (idx == vj) ? 1 : 0;
                 s1[idx] = subm(e,r);
@@ -100,24 +158,26 @@ int main(int argc, char* argv[]) {
                 s1f << s1[idx] << (idx + 1 == n ? "" : " ");
             }
             s1f << "\n";
+        }
 
-            // User-side DPF generation for target index vj with zero payload
-            auto [k0, k1] = generateDPF((u64) vj, /*value=*/0, (u64) n);
-            writeKey(dpf0, k0);
-            writeKey(dpf1, k1);
+        // DPF keys for all queries, in parallel (DPF_THREADS threads, default: all cores)
+        WorkStealingPool pool(dpfThreadsFromEnv());
+        auto t_keys = chrono::steady_clock::now();
+        vector<uint8_t> negate = generateKeysBulk(locations, (u64) n, pool, dpf0, dpf1);
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - t_keys).count();
+        for (uint8_t b : negate) dneg << (int)b << "\n";
+        cout << "Generated " << queries << " DPF key pairs in " << secs << " s ("
+             << (secs > 0 ? (u64)(queries / secs) : 0) << " key pairs/s on " << pool.size() << " threads)." << endl;
 
-            // Insecure global-negation bit: choose which party negates to make target positive
-            int s0_at = evalFlagAt(k0, vj, n) ? -1 : 1;
-            int s1_at = evalFlagAt(k1, vj, n) ? -1 : 1;
-            bool negateP0 = ((s0_at - s1_at) < 0); // if sum would be -2, flip
-            dneg << (negateP0 ? 1 : 0) << "\n";
-        }
         queries_file.close();
         queries_users.close();
         s0f.close();
         s1f.close();
         dneg.close();
-        cout << "Generated " << queries << " queries (public for verify), users-only, and secret selectors S0/S1." << endl;
+        dpf0.close();
+        dpf1.close();
+        cout << "Generated " << queries << " queries (public for verify), users-only"
+             << (bulk ? "." : ", and secret selectors S0/S1.") << endl;
 
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
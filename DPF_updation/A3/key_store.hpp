@@ -0,0 +1,206 @@
+#pragma once
+#include "DPF.hpp"
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary DPF key file, all words little-endian.
+//
+// Header (32 bytes):
+//   magic "DPFK" | u16 version | u16 leaf levels | u32 tree depth | u32 PRG id | u64 domain N | u64 count
+// followed by `count` fixed-size records (so key i sits at a known offset):
+//   u64 seed | u64 final_cw | u64 leaf_cw[2] | u64 cw[depth] | advice bitmap
+// The bitmap packs t0 into bit 0 and the left/right advice bits of level l into
+// bits 1+2l and 2+2l, padded to whole words.
+const char kDPFKeyMagic[4] = {'D', 'P', 'F', 'K'};
+const uint16_t kDPFKeyVersion = 1;
+const size_t kDPFKeyHeaderSize = 32;
+
+inline void putLE64(uint8_t* p, u64 v) {
+    for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+inline u64 getLE64(const uint8_t* p) {
+    u64 v;
+    std::memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+inline size_t keyBitmapWords(u64 depth) { return (2 * depth + 1 + 63) / 64; }
+
+inline size_t keyRecordSize(u64 depth) { return 8 * (4 + depth + keyBitmapWords(depth)); }
+
+// Writes one key as a record of keyRecordSize(key depth) bytes
+inline void encodeKeyRecord(const DPFKey& k, uint8_t* out) {
+    u64 depth = k.cw_s.size();
+    putLE64(out, k.seed);
+    putLE64(out + 8, (u64)DPF_getFinalCW(k));
+    putLE64(out + 16, k.leaf_cw.w[0]);
+    putLE64(out + 24, k.leaf_cw.w[1]);
+    uint8_t* cw = out + 32;
+    for (u64 l = 0; l < depth; ++l) putLE64(cw + 8 * l, k.cw_s[l].cw);
+
+    std::vector<u64> bits(keyBitmapWords(depth), 0);
+    auto setBit = [&](u64 i, bool b) { bits[i >> 6] |= (u64)b << (i & 63); };
+    setBit(0, k.t0);
+    for (u64 l = 0; l < depth; ++l) {
+        setBit(1 + 2 * l, k.cw_s[l].leftAdviceBit);
+        setBit(2 + 2 * l, k.cw_s[l].rightAdviceBit);
+    }
+    for (size_t w = 0; w < bits.size(); ++w) putLE64(cw + 8 * (depth + w), bits[w]);
+}
+
+// Zero-copy view of one record inside a mapped key file
+class DPFKeyView {
+public:
+    DPFKeyView(const uint8_t* rec, u64 depth) : rec(rec), d(depth) {}
+
+    u64 depth() const { return d; }
+    u64 seed() const { return getLE64(rec); }
+    ll finalCW() const { return (ll)getLE64(rec + 8); }
+    u64 leafCW(int i) const { return getLE64(rec + 16 + 8 * i); }
+    u64 cw(u64 level) const { return getLE64(rec + 32 + 8 * level); }
+    bool t0() const { return bit(0); }
+    bool leftAdvice(u64 level) const { return bit(1 + 2 * level); }
+    bool rightAdvice(u64 level) const { return bit(2 + 2 * level); }
+
+    // owning copy for the evaluators (a few hundred bytes per key)
+    DPFKey toKey() const {
+        DPFKey k;
+        k.cw_s.resize(d);
+        k.seed = seed();
+        k.t0 = t0();
+        k.final_cw = finalCW();
+        k.leaf_cw.w[0] = leafCW(0);
+        k.leaf_cw.w[1] = leafCW(1);
+        for (u64 l = 0; l < d; ++l) k.cw_s[l] = correctionWord{cw(l), leftAdvice(l), rightAdvice(l)};
+        return k;
+    }
+
+private:
+    bool bit(u64 i) const { return (getLE64(rec + 32 + 8 * (d + (i >> 6))) >> (i & 63)) & 1; }
+
+    const uint8_t* rec;
+    u64 d;
+};
+
+// Appends keys of one domain to a key file; the count in the header is patched on close()
+class DPFKeyWriter {
+public:
+    DPFKeyWriter(const std::string& path, u64 N) : out(path, std::ios::binary | std::ios::trunc), N(N) {
+        if (!out.is_open()) throw std::runtime_error("Could not open " + path + " for writing");
+        writeHeader();
+    }
+    ~DPFKeyWriter() {
+        try { close(); } catch (...) {}
+    }
+
+    void append(const DPFKey& k) {
+        if (k.cw_s.size() != dpfTreeDepth(N)) throw std::runtime_error("DPFKeyWriter: key depth does not match N");
+        buf.resize(keyRecordSize(k.cw_s.size()));
+        encodeKeyRecord(k, buf.data());
+        appendRecords(buf.data(), 1);
+    }
+
+    // pre-encoded records, e.g. from encodeKeyRecord on worker threads
+    void appendRecords(const uint8_t* records, u64 n) {
+        out.write((const char*)records, (std::streamsize)(n * keyRecordSize(dpfTreeDepth(N))));
+        count += n;
+    }
+
+    u64 size() const { return count; }
+
+    void close() {
+        if (!out.is_open()) return;
+        out.seekp(0);
+        writeHeader();
+        out.close();
+        if (out.fail()) throw std::runtime_error("DPFKeyWriter: write failed");
+    }
+
+private:
+    void writeHeader() {
+        uint8_t h[kDPFKeyHeaderSize] = {};
+        std::memcpy(h, kDPFKeyMagic, 4);
+        h[4] = (uint8_t)kDPFKeyVersion;
+        h[5] = (uint8_t)(kDPFKeyVersion >> 8);
+        h[6] = (uint8_t)kLeafLevels;
+        u64 depth = dpfTreeDepth(N);
+        for (int i = 0; i < 4; ++i) h[8 + i] = (uint8_t)(depth >> (8 * i));
+        for (int i = 0; i < 4; ++i) h[12 + i] = (uint8_t)(DefaultPRG::id >> (8 * i));
+        putLE64(h + 16, N);
+        putLE64(h + 24, count);
+        out.write((const char*)h, kDPFKeyHeaderSize);
+    }
+
+    std::ofstream out;
+    u64 N, count = 0;
+    std::vector<uint8_t> buf;
+};
+
+// Read-only key file mapped into memory; operator[] hands out views without copying
+class DPFKeyStore {
+public:
+    explicit DPFKeyStore(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < kDPFKeyHeaderSize) {
+            ::close(fd);
+            throw std::runtime_error(path + ": not a DPF key file");
+        }
+        bytes = (size_t)st.st_size;
+        void* p = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Could not mmap " + path);
+        base = (const uint8_t*)p;
+
+        uint32_t depth32 = 0, prg = 0;
+        for (int i = 0; i < 4; ++i) depth32 |= (uint32_t)base[8 + i] << (8 * i);
+        for (int i = 0; i < 4; ++i) prg |= (uint32_t)base[12 + i] << (8 * i);
+        uint16_t version = (uint16_t)(base[4] | base[5] << 8);
+        uint16_t leafLevels = (uint16_t)(base[6] | base[7] << 8);
+        depth = depth32;
+        N = getLE64(base + 16);
+        count = getLE64(base + 24);
+
+        std::string err;
+        if (std::memcmp(base, kDPFKeyMagic, 4) != 0) err = "not a DPF key file";
+        else if (version != kDPFKeyVersion) err = "unsupported key file version " + std::to_string(version);
+        else if (leafLevels != kLeafLevels) err = "keys use a different leaf block size";
+        else if (prg != DefaultPRG::id) err = "keys were generated with a different PRG backend";
+        else if (depth != dpfTreeDepth(N)) err = "tree depth does not match the domain";
+        // count comes from the file: bound it before multiplying so a corrupted header cannot wrap
+        else if (count > (bytes - kDPFKeyHeaderSize) / keyRecordSize(depth) ||
+                 bytes != kDPFKeyHeaderSize + count * keyRecordSize(depth)) err = "truncated key file";
+        if (!err.empty()) {
+            munmap((void*)base, bytes);
+            throw std::runtime_error(path + ": " + err);
+        }
+    }
+    ~DPFKeyStore() { munmap((void*)base, bytes); }
+
+    DPFKeyStore(const DPFKeyStore&) = delete;
+    DPFKeyStore& operator=(const DPFKeyStore&) = delete;
+
+    u64 size() const { return count; }
+    u64 domain() const { return N; }
+    DPFKeyView operator[](u64 i) const {
+        assert(i < count);
+        return DPFKeyView(base + kDPFKeyHeaderSize + i * keyRecordSize(depth), depth);
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+    u64 depth = 0, N = 0, count = 0;
+};
@@ -4,23 +4,17 @@
 #include "shares.hpp"
 #include <vector>
 #include "utility.hpp"
+#include "triple_pool.hpp"
+#include "transport.hpp"
+#include "shared_matrix.hpp"
 #include "DPF.hpp"
 using namespace std;
 typedef long long int ll;
 
-// coroutine to send a vector share
-awaitable<void> send_vec(tcp::socket& sock, const Share& vec) {
-    co_await boost::asio::async_write(sock, boost::asio::buffer(vec.data), use_awaitable);
-}
-
-// coroutine to receive a vector share
-awaitable<Share> recv_vec(tcp::socket& sock, size_t k) {
-    Share vec(k);
-    co_await boost::asio::async_read(sock, boost::asio::buffer(vec.data), use_awaitable);
-    co_return vec;
-}
+// DPF selection and the item update scale the +/-1 signs by 1/2
+static_assert(Ring::kHasHalf, "A3 needs a ring in which 2 is invertible (build without -DRING_Z2K64)");
 
-// coroutine to send a single value
+// coroutine to send a single value (a raw control word, not a ring element)
 awaitable<void> send_val(tcp::socket& sock, ll val) {
     co_await boost::asio::async_write(sock, boost::asio::buffer(&val, sizeof(val)), use_awaitable);
 }
@@ -32,142 +26,185 @@ awaitable<ll> recv_val(tcp::socket& sock) {
     co_return val;
 }
 
+// calls of one MPC primitive and the peer exchanges (rounds) they took
+struct RoundCounter {
+    const char* name;
+    uint64_t calls = 0;
+    uint64_t rounds = 0;
+};
+
 class MPCProtocol {
 private:
-    tcp::socket& peer_sock;
-    tcp::socket& p2_sock;
+    PeerTransport& net;
+    shared_ptr<TriplePool> pool;      // prefetched correlated randomness from P2
+    RoundCounter dotRounds{"MPC_DOTPRODUCT"}, scalarVecRounds{"scalarVecProd"}, matRounds{"vecMatProd"};
+    vector<ll> coeff;                 // selection coefficients, reused across queries
+    RingAccumulator matAcc{0};        // vecMatProd's z_b, reused likewise
+    Share uv;                         // fusedUpdate's [ui || vj], reused likewise
+
+    // opens masked values: net's outgoing messages [0, messages) go out and the
+    // peer's arrive in its incoming slots, in one full-duplex exchange counted against c
+    awaitable<void> openMasked(RoundCounter& c, size_t messages) {
+        ++c.rounds;
+        co_await net.exchange(messages);
+    }
     // Securely computes the dot product of two secret-shared vectors based on the image provided.
     awaitable<ll> MPC_DOTPRODUCT(const Share& x_b, const Share& y_b, int k) {
-        // beaver triplit
-        vector<BeaverTriple> triples = co_await getBeaverTriple(k);
-        Share a_b(k), b_b(k);
-        vector<ll> c_b(k);
-        for(int i=0; i<k; i++) {
-            a_b.data[i] = triples[i].a;
-            b_b.data[i] = triples[i].b;
-            c_b[i] = triples[i].c;
-        }
-        
-        // blinding the values 
-        Share alpha_b = x_b + a_b;
-        Share beta_b  = y_b + b_b;
-
-        // Exchange masked values to reconstruct them publicly
-        co_await send_vec(peer_sock, alpha_b);
-        Share alpha_peer = co_await recv_vec(peer_sock, k);
-        Share alpha = alpha_b + alpha_peer;
-
-        co_await send_vec(peer_sock, beta_b);
-        Share beta_peer = co_await recv_vec(peer_sock, k);
-        Share beta = beta_b + beta_peer;
-
-        ll prodShare = 0;
-        for (int i = 0; i < k; i++) {
-            // (x+a)*y_b - (y+b)*a_b + c_b <- beaver method to get mulmiplication share
-            ll term = addm(subm(mulm(alpha.data[i], y_b.data[i]),mulm(beta.data[i],  a_b.data[i])),c_b[i]);
-            prodShare = addm(prodShare, term);
-        }
-        co_return prodShare;
+        ++dotRounds.calls;
+        // inner-product triple: a, b of length k and c = <a, b>
+        InnerProductTriple t = co_await getInnerProductTriple(k);
+
+        // blinding the values: alpha_b = x_b + a_b and beta_b = y_b + b_b,
+        // two messages in one write
+        ll* alpha_b = net.outgoing(0, k);
+        ll* beta_b = net.outgoing(1, k);
+        copy(x_b.data.begin(), x_b.data.begin() + k, alpha_b);
+        copy(y_b.data.begin(), y_b.data.begin() + k, beta_b);
+        ringAddInto(alpha_b, t.a.data(), k);
+        ringAddInto(beta_b, t.b.data(), k);
+
+        // Exchange masked values to reconstruct them publicly (one round)
+        co_await openMasked(dotRounds, 2);
+        ll* alpha = net.incoming(0);
+        ll* beta = net.incoming(1);
+        ringAddInto(alpha, alpha_b, k);
+        ringAddInto(beta, beta_b, k);
+
+        // <x+a, y_b> - <y+b, a_b> + c_b <- beaver method to get mulmiplication share
+        co_return addm(t.c, subm(ringDot(alpha, y_b.data.data(), k), ringDot(beta, t.a.data(), k)));
     }
     
     // Securely computes the product of a secret-shared scalar and a secret-shared vector
     awaitable<Share> scalarVecProd(ll scalar_share, const Share& vec_share, int k) {
-        // Get Beaver triples from P2
-        vector<BeaverTriple> triples = co_await getBeaverTriple(k);
-        Share a_b(k), b_b(k); // a is scalar, b is vector
-        vector<ll> c_b(k);
-        for(int i=0; i<k; ++i) {
-            a_b.data[i] = triples[i].a; // Re-using vector share for scalar shares
-            b_b.data[i] = triples[i].b;
-            c_b[i] = triples[i].c;
-        }
-        
-        // Mask scalar and vector (mod)
-        ll alpha_b = addm(scalar_share, a_b.data[0]);
-        Share beta_b = vec_share + b_b;
-
-        // Exchange and reconstruct (mod)
-        co_await send_val(peer_sock, alpha_b);
-        ll alpha_peer = co_await recv_val(peer_sock);
-        ll alpha = addm(alpha_b, alpha_peer);
-
-        co_await send_vec(peer_sock, beta_b);
-        Share beta_peer = co_await recv_vec(peer_sock, k);
-        Share beta = beta_b + beta_peer;
-
-        Share result(k);
-        for (int i = 0; i < k; i++) {
-            // (s+a)*v_b[i] - (v[i]+b[i])*a + c[i]
-            result.data[i] = addm(subm(mulm(alpha,vec_share.data[i]), mulm(beta.data[i],a_b.data[0])), c_b[i]);
-        }
+        ++scalarVecRounds.calls;
+        // scalar x vector triple: one a, b of length k, c[i] = a * b[i]
+        ScalarVecTriple t = co_await getScalarVecTriple(k);
+
+        // Mask scalar and vector (mod): alpha_b and beta_b, two messages in one write
+        ll* alpha_b = net.outgoing(0, 1);
+        ll* beta_b = net.outgoing(1, k);
+        alpha_b[0] = addm(scalar_share, t.a);
+        copy(vec_share.data.begin(), vec_share.data.begin() + k, beta_b);
+        ringAddInto(beta_b, t.b.data(), k);
+
+        // Exchange and reconstruct (mod), one round
+        co_await openMasked(scalarVecRounds, 2);
+        ll alpha = addm(net.incoming(0)[0], alpha_b[0]);
+        ll* beta = net.incoming(1);
+        ringAddInto(beta, beta_b, k);
+
+        // (s+a)*v_b[i] - (v[i]+b[i])*a + c[i]
+        Share result(std::move(t.c));
+        ringAxpy(result.data.data(), alpha, vec_share.data.data(), k);
+        ringAxpy(result.data.data(), (ll)Ring::neg(t.a), beta, k);
         co_return result;
     }
     
-    // request for k Beaver mulmiplication triples from P2
-    awaitable<vector<BeaverTriple>> getBeaverTriple(int k) {
-        // Only P0 sends the request to P2; P1 passively receives triples.
-        #ifdef ROLE_p0
-        co_await send_val(p2_sock, k);
-        #endif
+    // correlations from the pool (requested from P2 ahead of time by P0)
+    awaitable<InnerProductTriple> getInnerProductTriple(int k) {
+        co_return co_await pool->takeInnerProduct(k);
+    }
+
+    awaitable<ScalarVecTriple> getScalarVecTriple(int k) {
+        co_return co_await pool->takeScalarVec(k);
+    }
 
-        vector<BeaverTriple> triples(k);
-        co_await boost::asio::async_read(p2_sock, boost::asio::buffer(triples), use_awaitable);
-        co_return triples;
+    // vector-matrix triple (a: rows, B: rows x cols, C = a^T B) from the pool
+    awaitable<MatrixTriple> getMatrixTriple(u64 rows, int cols) {
+        co_return co_await pool->takeMatrix((ll)rows, cols);
     }
 
-    // Select item v_j obliviously using secret-shared one-hot s (length n):
-    // v_sel[d] = <s, V_col[d]> for d=0..k-1
-    awaitable<Share> select_item_oblivious(const Share& s_b,const vector<Share>& V_rows_b, int n, int k) {
-        Share select_b(k);
-        for (int d = 0; d < k; d++) {
-            Share col_d(n);
-            for (int t = 0; t < n; ++t) col_d.data[t] = V_rows_b[t].data[d];
-            ll coord_share = co_await MPC_DOTPRODUCT(s_b, col_d, n);
-            select_b.data[d] = coord_share;
+    // Securely computes c^T V over the first c.size() shared rows of V:
+    // one triple request and one exchange of e = c + a and F = V + B, then
+    // z_b = [b = 0] e^T F - e^T B_b - a_b^T F + C_b.
+    awaitable<Share> vecMatProd(const vector<ll>& c_b, const SharedMatrix& V_rows_b, int k) {
+        ++matRounds.calls;
+        u64 rows = c_b.size();
+        MatrixTriple t = co_await getMatrixTriple(rows, k);
+
+        // e_b (rows entries) and F_b (row-major) go out as two messages in one write
+        ll* e_b = net.outgoing(0, rows);
+        ll* F_b = net.outgoing(1, rows * k);
+        copy(c_b.begin(), c_b.end(), e_b);
+        copy(V_rows_b.rowData(0), V_rows_b.rowData(0) + rows * k, F_b);   // rows are contiguous
+        ringAddInto(e_b, t.a.data(), rows);
+        ringAddInto(F_b, t.B.data(), rows * k);
+        co_await openMasked(matRounds, 2);
+        ll* e_open = net.incoming(0);
+        ll* F_open = net.incoming(1);
+        ringAddInto(e_open, e_b, rows);
+        ringAddInto(F_open, F_b, rows * k);
+
+        // per row: z_b += ([b = 0] e - a_b) F_r - e B_b,r, reduced once at the end
+        RingAccumulator& z = matAcc;
+        z.reset(k);
+        for (u64 r = 0; r < rows; ++r) {
+            ll e = e_open[r];
+            const ll* F = F_open + r * k;
+        #ifdef ROLE_p0
+            z.axpy(subm(e, t.a[r]), F);
+        #else
+            z.axpy((ll)Ring::neg(t.a[r]), F);
+        #endif
+            z.axpy((ll)Ring::neg(e), t.B.data() + r * k);
         }
-        co_return select_b;
+        Share out(std::move(t.C));
+        z.addTo(out.data.data());
+        co_return out;
+    }
+
+    // coeff[first + j] = signs[j] / 2 (+/- 1/2 in the ring) for j < count
+    void signCoefficients(const int8_t* signs, u64 first, u64 count) {
+        const ll inv2 = (ll)Ring::half();
+        const ll minusInv2 = (ll)Ring::neg(inv2);
+        for (u64 j = 0; j < count; ++j) coeff[first + j] = (signs[j] == 1) ? inv2 : minusInv2;
     }
 
 public:
 
-    MPCProtocol(tcp::socket& peer, tcp::socket& p2) : peer_sock(peer), p2_sock(p2) {}
+    MPCProtocol(PeerTransport& peer, tcp::socket& p2) : net(peer), pool(make_shared<TriplePool>(p2)) {
+        pool->start();
+    }
+
+    TriplePool& triplePool() { return *pool; }
+
+    // one line per primitive: calls, peer rounds and rounds per call
+    void printRounds(ostream& os, const string& role) const {
+        for (const RoundCounter* c : {&dotRounds, &scalarVecRounds, &matRounds}) {
+            os << role << ": " << c->name << " calls=" << c->calls << " rounds=" << c->rounds;
+            if (c->calls) os << " (" << (double)c->rounds / c->calls << " per call)";
+            os << endl;
+        }
+    }
 
     // DPF-based selection of v_j:
     // Evaluate DPF to get signed vector s in {+1,-1}^n (with insecure global negation).
-    // Coeff per index: coeff = s/2 (mod p). Across parties, coeffs sum to 1 at j and 0 elsewhere.
+    // Coeff per index: coeff = s/2 in the ring. Across parties, coeffs sum to 1 at j and 0 elsewhere.
     // Return v_sel = sum_t coeff_t * V[t].
+    // The DPF is streamed block by block, so no sign vector is materialised; the
+    // blocks' coefficients are gathered first, so the whole selection is still one
+    // triple request and one exchange with the peer.
     awaitable<Share> DPF_select_item(const DPFKey& key, bool negateThisParty,
-                                     const vector<Share>& V_rows_b, int n, int k) {
-        const ll inv2 = (mod + 1) / 2; // 1/2 mod p (p odd)
-        vector<int8_t> signs = evalSigns(key, (u64)n, negateThisParty);
-        Share acc(k); // zero
-        for (int idx = 0; idx < n; ++idx) {
-            ll s_mod = (signs[idx] == 1) ? 1 : (mod - 1);
-            ll coeff = mulm(s_mod, inv2);         // coeff = +/- 1/2
-            Share term = co_await scalarVecProd(coeff, V_rows_b[idx], k);
-            for (int d = 0; d < k; ++d) acc.data[d] = addm(acc.data[d], term.data[d]);
-        }
-        co_return acc; // equals v_j in additive shares
+                                     const SharedMatrix& V_rows_b, int n, int k) {
+        coeff.resize(n);
+        DPFLeafStream stream(key, (u64)n);
+        while (stream.next())
+            signCoefficients(stream.signs(negateThisParty), stream.first(), stream.count());
+        co_return co_await vecMatProd(coeff, V_rows_b, k); // equals v_j in additive shares
     }
 
-    // function for full secure update protocol for u_i <- u_i + v_j * (1 - <u_i, v_j>)
-    awaitable<Share> updateProtocol(const Share& ui, const Share& vj, int k) {
-        ll prodShare = co_await MPC_DOTPRODUCT(ui, vj, k);
-
-        ll delta_share;
-        #ifdef ROLE_p0
-            delta_share = subm(1, prodShare);
-        #else
-            delta_share = subm(0, prodShare);
-        #endif
-
-        Share prod_vec_share = co_await scalarVecProd(delta_share, vj, k);
-        Share u_prime_b = ui + prod_vec_share;
-        co_return u_prime_b;
+    // Same selection from signs that were already evaluated (e.g. by evalSignsBatch)
+    awaitable<Share> DPF_select_item(const vector<int8_t>& signs,
+                                     const SharedMatrix& V_rows_b, int n, int k) {
+        coeff.resize(n);
+        signCoefficients(signs.data(), 0, (u64)n);
+        co_return co_await vecMatProd(coeff, V_rows_b, k); // equals v_j in additive shares
     }
 
-    // New: item update share M = ui * (1 - <ui, vj>)
-    awaitable<Share> itemUpdateShare(const Share& ui, const Share& vj, int k) {
+    // Fused user + item update: <ui, vj> is computed once and delta = 1 - <ui, vj>
+    // multiplies [ui || vj] in a single scalar x vector product of length 2k.
+    // Returns {ui' = ui + vj * delta, M = ui * delta}.
+    awaitable<pair<Share, Share>> fusedUpdate(const Share& ui, const Share& vj, int k) {
         ll prodShare = co_await MPC_DOTPRODUCT(ui, vj, k);
         ll delta_share;
         #ifdef ROLE_p0
@@ -175,13 +212,16 @@ public:
         #else
             delta_share = subm(0, prodShare);
         #endif
-        Share m_b = co_await scalarVecProd(delta_share, ui, k);
-        co_return m_b;
-    }
 
-    // Expose oblivious selection for caller
-    awaitable<Share> OT_select(const Share& s_b, const vector<Share>& V_rows_b, int n, int k) {
-        co_return co_await select_item_oblivious(s_b, V_rows_b, n, k);
+        uv.data.resize(2 * k);
+        copy(ui.data.begin(), ui.data.end(), uv.data.begin());
+        copy(vj.data.begin(), vj.data.end(), uv.data.begin() + k);
+        Share m_b = co_await scalarVecProd(delta_share, uv, 2 * k);   // [ui * delta || vj * delta]
+
+        Share u_prime_b = ui;
+        ringAddInto(u_prime_b.data.data(), m_b.data.data() + k, k);
+        m_b.data.resize(k);
+        co_return make_pair(std::move(u_prime_b), std::move(m_b));
     }
 };
 
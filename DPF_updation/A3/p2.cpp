@@ -3,77 +3,147 @@
 #include <boost/asio.hpp>
 #include <boost/asio/read.hpp>
 #include <iostream>
+#include <map>
+#include <optional>
 #include "utility.hpp"
+#include "triple_factory.hpp"
 using namespace std;
 typedef long long int ll;
 
-// provides connected clients (P0 and P1) with Beaver triples.
-awaitable<void> handle_clients(tcp::socket p0_socket, tcp::socket p1_socket) {
-    try {
-        ll k;
-        // read requests from P0 only
-        co_await boost::asio::async_read(p0_socket, boost::asio::buffer(&k, sizeof(k)), use_awaitable);
-        cout << "P2: Received request for " << k << " triples." << endl;
+// Compressed (default): P0 gets only the seed of its shares. P2_DEALER=full
+// sends P0 its expanded shares instead, as before.
+bool compressedDealer() {
+    const char* env = getenv("P2_DEALER");
+    return !(env && string(env) == "full");
+}
 
-        while(k>0){
-            vector<BeaverTriple> p0_triples(k), p1_triples(k);
+// every payload is preceded by the request it answers, so P1 (which never sees
+// P0's requests) knows what follows and both parties can queue triples ahead of use
+awaitable<size_t> send_shares(tcp::socket& sock, const TripleRequest& req, const vector<uint8_t>& frame) {
+    std::array<boost::asio::const_buffer, 2> bufs = {boost::asio::buffer(&req, sizeof(req)), boost::asio::buffer(frame)};
+    co_return co_await boost::asio::async_write(sock, bufs, use_awaitable);
+}
 
-            // Single 'a' across k (matches scalarVecProd)
-            ll a  = norm(random_uint32()%mod);
-            ll a0 = norm(random_uint32()%mod);
-            ll a1 = subm(a, a0);
+// P0's copy of the header carries TRIPLE_SEEDED and is followed by the seed alone
+awaitable<size_t> send_seed(tcp::socket& sock, TripleRequest req, const TripleSeed& seed) {
+    req.kind |= TRIPLE_SEEDED;
+    std::array<boost::asio::const_buffer, 2> bufs = {boost::asio::buffer(&req, sizeof(req)), boost::asio::buffer(&seed, sizeof(seed))};
+    co_return co_await boost::asio::async_write(sock, bufs, use_awaitable);
+}
 
-            for(ll i=0; i<k; ++i) {
-                ll b  = norm(random_uint32()%mod);
-                ll c  = mulm(a, b);
+// provides connected clients (P0 and P1) with Beaver triples. Generation runs
+// on the factory's workers; this coroutine only takes finished triples and writes.
+awaitable<void> handle_clients(tcp::socket p0_socket, tcp::socket p1_socket, TripleFactory& factory, bool compressed,
+                               uint64_t session_id) {
+    size_t p0_bytes = 0, p1_bytes = 0;
+    shared_ptr<TripleFactory::Session> session = factory.openSession(session_id);
+    try {
+        cout << "P2: session " << session_id << ": " << (compressed ? "seed-compressed" : "full")
+             << " triples for P0, " << factory.threads() << " generator threads." << endl;
+        TripleRequest req;
+        // read requests from P0 only
+        co_await boost::asio::async_read(p0_socket, boost::asio::buffer(&req, sizeof(req)), use_awaitable);
 
-                ll b0 = norm(random_uint32()%mod);
-                ll c0 = norm(random_uint32()%mod);
+        while(req.kind != TRIPLE_END){
+            if(req.kind == TRIPLE_SCALAR_VEC){
+                cout << "P2: session " << session_id << ": request for a scalar x vector triple of length " << req.cols << "." << endl;
+            }else if(req.kind == TRIPLE_INNER_PRODUCT){
+                cout << "P2: session " << session_id << ": request for an inner-product triple of length " << req.cols << "." << endl;
+            }else if(req.kind == TRIPLE_MATRIX){
+                cout << "P2: session " << session_id << ": request for a " << req.rows << "x" << req.cols << " matrix triple." << endl;
+            }else{
+                throw runtime_error("unknown triple request " + to_string(req.kind));
+            }
+            DealtTriple d = co_await factory.take(*session, req);
+            if (compressed) p0_bytes += co_await send_seed(p0_socket, req, d.seed);
+            else p0_bytes += co_await send_shares(p0_socket, req, d.p0);
+            p1_bytes += co_await send_shares(p1_socket, req, d.p1);
+
+            // Next request (still from P0 only)
+            co_await boost::asio::async_read(p0_socket, boost::asio::buffer(&req, sizeof(req)), use_awaitable);
+        }
+        co_await boost::asio::async_write(p0_socket, boost::asio::buffer(&req, sizeof(req)), use_awaitable);
+        co_await boost::asio::async_write(p1_socket, boost::asio::buffer(&req, sizeof(req)), use_awaitable);
+        cout << "P2: session " << session_id << ": end of session." << endl;
+        cout << "P2: session " << session_id << ": sent " << p0_bytes << " bytes to P0, " << p1_bytes << " bytes to P1." << endl;
+        factory.printStats(cout, *session);
+    } catch (exception& e) { cout << "P2: session " << session_id << ": closing connection: " << e.what() << "\n"; }
+    factory.closeSession(session);
+}
 
-                ll b1 = subm(b, b0);
-                ll c1 = subm(c, c0);
+// Accepts connections and pairs them into sessions by the ID in their hello.
+// With `once` the dealer serves the first complete session and then stops
+// accepting; otherwise it runs until killed, any number of sessions at a time.
+class Dealer {
+public:
+    Dealer(tcp::acceptor& acceptor, TripleFactory& factory, bool compressed, bool once)
+        : acceptor(acceptor), factory(factory), compressed(compressed), once(once) {}
 
-                p0_triples[i] = {a0, b0, c0};
-                p1_triples[i] = {a1, b1, c1};
+    awaitable<void> acceptLoop() {
+        try {
+            for (;;) {
+                tcp::socket sock = co_await acceptor.async_accept(use_awaitable);
+                co_spawn(acceptor.get_executor(), greet(std::move(sock)), detached);
             }
+        } catch (exception& e) {
+            if (acceptor.is_open()) cerr << "P2: accept failed: " << e.what() << endl;
+        }
+    }
 
-            co_await boost::asio::async_write(p0_socket, boost::asio::buffer(p0_triples), use_awaitable);
-            co_await boost::asio::async_write(p1_socket, boost::asio::buffer(p1_triples), use_awaitable);
+private:
+    struct PendingPair {
+        optional<tcp::socket> party[2];
+    };
 
-            // Next request (still from P0 only)
-            co_await boost::asio::async_read(p0_socket, boost::asio::buffer(&k, sizeof(k)), use_awaitable);
-            cout << "P2: Received request for " << k << " triples." << endl;
+    awaitable<void> greet(tcp::socket sock) {
+        DealerHello hello;
+        try {
+            co_await boost::asio::async_read(sock, boost::asio::buffer(&hello, sizeof(hello)), use_awaitable);
+        } catch (exception& e) {
+            cerr << "P2: connection closed before its hello: " << e.what() << endl;
+            co_return;
         }
-    } catch (exception& e) { cout << "P2 closing connection: " << e.what() << "\n"; }
-}
+        if (hello.role > 1) {
+            cerr << "P2: invalid role handshake: role=" << hello.role << " session=" << hello.session << endl;
+            co_return;
+        }
+        PendingPair& waiting = pending[hello.session];
+        if (waiting.party[hello.role]) {
+            cerr << "P2: session " << hello.session << " already has a P" << hello.role << "; dropping connection" << endl;
+            co_return;
+        }
+        cout << "P2 accepted P" << hello.role << " of session " << hello.session << "." << endl;
+        waiting.party[hello.role] = std::move(sock);
+        if (!waiting.party[0] || !waiting.party[1]) co_return;
+
+        tcp::socket p0_socket = std::move(*waiting.party[0]);
+        tcp::socket p1_socket = std::move(*waiting.party[1]);
+        pending.erase(hello.session);
+        if (once) acceptor.close();
+        co_await handle_clients(std::move(p0_socket), std::move(p1_socket), factory, compressed, hello.session);
+    }
+
+    tcp::acceptor& acceptor;
+    TripleFactory& factory;
+    bool compressed, once;
+    map<uint64_t, PendingPair> pending;   // sessions still waiting for a party
+};
 
 int main(int argc, char* argv[]) {
+    // --serve: keep accepting sessions instead of exiting after the first one
+    bool serve = false;
+    for (int i = 1; i < argc; ++i) if (string(argv[i]) == "--serve") serve = true;
     try {
         boost::asio::io_context io_context;
         tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 9002));
 
-        cout << "P2 listening on port 9002..." << endl;
-
-        // Accept two connections (order is non-deterministic)
-        tcp::socket sA = acceptor.accept();
-        cout << "P2 accepted connection A." << endl;
-        tcp::socket sB = acceptor.accept();
-        cout << "P2 accepted connection B." << endl;
-
-        // Read 1-byte role from each: 0 => P0, 1 => P1
-        uint8_t rA = 255, rB = 255;
-        boost::asio::read(sA, boost::asio::buffer(&rA, 1));
-        boost::asio::read(sB, boost::asio::buffer(&rB, 1));
-        if (!((rA == 0 || rA == 1) && (rB == 0 || rB == 1) && (rA != rB))) {
-            cerr << "P2: invalid role handshake: rA=" << (int)rA << " rB=" << (int)rB <<endl;
-            return 1;
-        }
-
-        tcp::socket p0_socket = (rA == 0) ? std::move(sA) : std::move(sB);
-        tcp::socket p1_socket = (rA == 1) ? std::move(sA) : std::move(sB);
+        cout << "P2 listening on port 9002" << (serve ? " (serving sessions until killed)" : "")
+             << ", ring " << Ring::kName << "..." << endl;
 
-        // Spawn coroutine to serve triples (reads k only from P0)
-        co_spawn(io_context, handle_clients(std::move(p0_socket), std::move(p1_socket)), detached);
+        bool compressed = compressedDealer();
+        TripleFactory factory(io_context.get_executor(), factoryThreadsFromEnv(), compressed);
+        Dealer dealer(acceptor, factory, compressed, !serve);
+        co_spawn(io_context, dealer.acceptLoop(), detached);
         io_context.run();
     } catch (exception& e) {
         cerr << "Exception in P2: " << e.what() << "\n";
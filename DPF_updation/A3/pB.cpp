@@ -3,6 +3,8 @@
 #include "mpc.hpp"
 #include "utility.hpp"
 #include "DPF.hpp"
+#include "thread_pool.hpp"
+#include "key_store.hpp"
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
@@ -13,6 +15,9 @@ using namespace std;
 #error "ROLE must be defined as ROLE_p0 or ROLE_p1"
 #endif
 
+// item count above which DPF signs are streamed instead of evaluated in batches
+const u64 kStreamingItems = 1ULL << 20;
+
 // setting up connection with P2
 awaitable<tcp::socket> setup_p2_connection(boost::asio::io_context& io_context) {
     tcp::resolver resolver(io_context);
@@ -49,15 +54,16 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
         tcp::socket peer_sock = co_await setup_peer_connection(io_context);
         cout << role << ": Connections established." << endl;
 
-        // Identify to P2 (P0=0, P1=1)
+        // Identify to P2 (P0=0, P1=1) and name the session both parties share
         {
-            uint8_t rid =
+            DealerHello hello{
             #ifdef ROLE_p0
-                0;
+                0,
             #else
-                1;
+                1,
             #endif
-            co_await boost::asio::async_write(p2_sock, boost::asio::buffer(&rid, 1), use_awaitable);
+                sessionIdFromEnv()};
+            co_await boost::asio::async_write(p2_sock, boost::asio::buffer(&hello, sizeof(hello)), use_awaitable);
         }
 
         // reading the data 
@@ -67,43 +73,29 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
         #else
             u_file = "U1.txt"; v_file = "V1.txt";
         #endif
-        vector<Share> u_shares = read_vector(u_file, k);
-        vector<Share> v_shares = read_vector(v_file, k); // n rows, k dims
-        int n = static_cast<int>(v_shares.size());
+        SharedMatrix u_shares = read_matrix(u_file, k);
+        SharedMatrix v_shares = read_matrix(v_file, k); // n rows, k dims
+        int n = static_cast<int>(v_shares.rows());
 
         // Read user-only queries (one user index per line)
         auto users_only = read_users("queries_users.txt");
         
         cout << role << ": Read data for " << users_only.size() << " queries (private item index)." << endl;
-        cout << role << ": counts -> U=" << u_shares.size()
-             << " V(n)=" << v_shares.size()
+        cout << role << ": counts -> U=" << u_shares.rows()
+             << " V(n)=" << v_shares.rows()
              << " k=" << k
+             << " V bytes=" << v_shares.bytes()
              << " queries(users_only)=" << users_only.size() << endl;
 
-        // New: read DPF keys and negate hints
-        vector<DPFKey> dpf_keys;
-        {
-            ifstream kif(
-            #ifdef ROLE_p0
-                "DPF0.txt"
-            #else
-                "DPF1.txt"
-            #endif
-            );
-            if (!kif.is_open()) throw runtime_error("Could not open DPF0.txt/DPF1.txt");
-            while (kif.peek() != EOF) {
-                streampos pos = kif.tellg();
-                try {
-                    DPFKey K = readKey(kif);
-                    dpf_keys.push_back(K);
-                } catch (...) {
-                    kif.clear();
-                    kif.seekg(pos);
-                    string dummy;
-                    if (!(kif >> dummy)) break;
-                }
-            }
-        }
+        // New: DPF keys are memory-mapped, each key is decoded when its query runs
+        DPFKeyStore dpf_keys(
+        #ifdef ROLE_p0
+            "DPF0.bin"
+        #else
+            "DPF1.bin"
+        #endif
+        );
+        if (dpf_keys.domain() != (u64)n) throw runtime_error("DPF keys were generated for a different item count");
         vector<int> negateBits;
         {
             ifstream nf("DPF_NEG.txt");
@@ -115,7 +107,8 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             throw runtime_error("DPF files count mismatch with queries");
         }
 
-        MPCProtocol mpc(peer_sock, p2_sock);
+        PeerTransport net(peer_sock);
+        MPCProtocol mpc(net, p2_sock);
 
         // No user reconstruction anymore; only item update via DPF
         // For verification we will also reconstruct updated users on P0.
@@ -124,7 +117,37 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
         std::vector<long long> item_us, user_us;
         #endif
 
-        const ll inv2 = (mod + 1) / 2; // since mod is prime
+        const ll inv2 = (ll)Ring::half();
+        const ll minusInv2 = (ll)Ring::neg(inv2);
+        // per-query vectors, reused so that steady-state queries do not allocate them
+        Share u_b(k), halfFCW(k), minusHalfFCW(k);
+        #ifdef ROLE_p0
+        Share fresh_p0(k);
+        #endif
+
+        // DPF signs are evaluated kMaxBatchKeys queries at a time in lock step;
+        // they only depend on the keys, so each query reuses them for selection and update.
+        // The evaluation is split across DPF_THREADS worker threads (default: all cores).
+        // Above kStreamingItems the sign vectors are not materialised at all: the DPF is
+        // streamed block by block with O(log n) tree state for both selection and update.
+        vector<vector<int8_t>> batchSigns;
+        WorkStealingPool pool(dpfThreadsFromEnv());
+        const bool streamDPF = ((u64)n > kStreamingItems);
+        cout << role << ": DPF evaluation on " << pool.size() << " threads"
+             << (streamDPF ? " (streaming)" : "") << endl;
+        // fill the triple pool for every per-query shape before the first query;
+        // each query takes one triple of each, so no more than that is requested
+        size_t queries = users_only.size();
+        mpc.triplePool().prefetch(TRIPLE_INNER_PRODUCT, 1, k, queries);   // <u_i, v_j>
+        mpc.triplePool().prefetch(TRIPLE_SCALAR_VEC, 1, 2 * k, queries);  // delta * [u_i || v_j]
+        mpc.triplePool().prefetch(TRIPLE_MATRIX, n, k, queries);          // selection
+        auto negateFor = [&](size_t q) {
+        #ifdef ROLE_p0
+            return negateBits[q] == 1;
+        #else
+            return negateBits[q] == 0;
+        #endif
+        };
 
         for (size_t q = 0; q < users_only.size(); ++q) {
             int user_idx = users_only[q];
@@ -137,55 +160,72 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             #endif
 
             // DPF-based selection
-            const DPFKey& myKey = dpf_keys[q];
-            bool negateThisParty =
-            #ifdef ROLE_p0
-                (negateBits[q] == 1);
-            #else
-                (negateBits[q] == 0);
-            #endif
-            Share v_sel_b = co_await mpc.DPF_select_item(myKey, negateThisParty, v_shares, n, k);
+            DPFKey myKey = dpf_keys[q].toKey();
+            bool negateThisParty = negateFor(q);
+            Share v_sel_b;
+            const vector<int8_t>* signs = nullptr;
+            if (streamDPF) {
+                v_sel_b = co_await mpc.DPF_select_item(myKey, negateThisParty, v_shares, n, k);
+            } else {
+                if (q % kMaxBatchKeys == 0) {
+                    vector<DPFKey> batchKeyData;
+                    vector<bool> batchNegate;
+                    for (size_t b = q; b < users_only.size() && b < q + kMaxBatchKeys; ++b) {
+                        batchKeyData.push_back(dpf_keys[b].toKey());
+                        batchNegate.push_back(negateFor(b));
+                    }
+                    vector<const DPFKey*> batchKeys;
+                    for (const DPFKey& key : batchKeyData) batchKeys.push_back(&key);
+                    batchSigns = evalSignsBatch(batchKeys, (u64)n, batchNegate, pool);
+                }
+                signs = &batchSigns[q % kMaxBatchKeys];
+                v_sel_b = co_await mpc.DPF_select_item(*signs, v_shares, n, k);
+            }
 
-            // Item update share
-            Share& u_b = u_shares[user_idx];
-            Share M_b = co_await mpc.itemUpdateShare(u_b, v_sel_b, k);
+            // User update and item update share from one dot product and one multiplication round
+            copy(u_shares.rowData(user_idx), u_shares.rowData(user_idx) + k, u_b.data.begin());
+            auto [u_prime_b, M_b] = co_await mpc.fusedUpdate(u_b, v_sel_b, k);
 
+            // The masked FCW and u'_b are opened together: two messages, one round
             ll fcw_b = DPF_getFinalCW(myKey);
-            Share masked(k);
-            for (int d = 0; d < k; ++d) masked.data[d] = subm(M_b.data[d], fcw_b);
-            co_await send_vec(peer_sock, masked);
-            Share peer_masked = co_await recv_vec(peer_sock, k);
-            Share FCWm = masked + peer_masked;
+            ll* masked = net.outgoing(0, k);
+            for (int d = 0; d < k; ++d) masked[d] = subm(M_b.data[d], fcw_b);
+            ll* u_prime_mine = net.outgoing(1, k);
+            copy(u_prime_b.data.begin(), u_prime_b.data.end(), u_prime_mine);
+            co_await net.exchange(2);
+            ll* FCWm = net.incoming(0);
+            ringAddInto(FCWm, masked, k);
 
-            vector<int8_t> signs = evalSigns(myKey, (u64)n, negateThisParty);
-            for (int idx = 0; idx < n; ++idx) {
-                ll s_mod = (signs[idx] == 1) ? 1 : (mod - 1);
-                ll coeff = mulm(s_mod, inv2);
-                for (int d = 0; d < k; ++d) {
-                    ll add = mulm(coeff, FCWm.data[d]);
-                    v_shares[idx].data[d] = addm(v_shares[idx].data[d], add);
-                }
-            }
+            // V[t] += (s_t/2) * FCWm for every item t: one sweep over V adding +/- FCWm/2
+            fill(halfFCW.data.begin(), halfFCW.data.end(), 0);
+            fill(minusHalfFCW.data.begin(), minusHalfFCW.data.end(), 0);
+            ringAxpy(halfFCW.data.data(), inv2, FCWm, k);
+            ringAxpy(minusHalfFCW.data.data(), minusInv2, FCWm, k);
+            auto applyItemUpdate = [&](u64 first, const int8_t* s, u64 count) {
+                for (u64 j = 0; j < count; ++j)
+                    v_shares[first + j] += (s[j] == 1) ? halfFCW : minusHalfFCW;
+            };
+            if (streamDPF) evalSignsStream(myKey, (u64)n, negateThisParty, kDPFStreamBlock, applyItemUpdate);
+            else applyItemUpdate(0, signs->data(), (u64)n);
 
             auto t_item_end = chrono::steady_clock::now();
 
             auto t_user_start = chrono::steady_clock::now();
-            // User update
-            Share u_prime_b = co_await mpc.updateProtocol(u_b, v_sel_b, k);
-            u_shares[user_idx] = u_prime_b;
-
-            co_await send_vec(peer_sock, u_prime_b);
-            Share u_prime_peer = co_await recv_vec(peer_sock, k);
-            Share u_reconstructed = u_prime_b + u_prime_peer;
+            // User update: u' was opened with the FCW above; re-share it randomized
+            ll* u_reconstructed = net.incoming(1);
+            ringAddInto(u_reconstructed, u_prime_mine, k);
             #ifdef ROLE_p0
-                final_reconstructed[user_idx] = u_reconstructed;
-                Share new_p0(k); new_p0.randomizer();
-                Share new_p1 = u_reconstructed - new_p0;
-                u_shares[user_idx] = new_p0;
-                co_await send_vec(peer_sock, new_p1);
+                final_reconstructed[user_idx].data.assign(u_reconstructed, u_reconstructed + k);
+                fresh_p0.randomizer();
+                ll* new_p1 = net.outgoing(0, k);
+                copy(u_reconstructed, u_reconstructed + k, new_p1);
+                ringSubInto(new_p1, fresh_p0.data.data(), k);
+                u_shares[user_idx] = fresh_p0;
+                co_await net.send(1);
             #else
-                Share new_p1 = co_await recv_vec(peer_sock, k);
-                u_shares[user_idx] = new_p1;
+                net.expect(0, k);
+                co_await net.recv(1);
+                u_shares[user_idx].assign(net.incoming(0));
             #endif
             auto t_user_end = chrono::steady_clock::now();
 
@@ -195,10 +235,10 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             #endif
         }
 
-        // Signal end of protocol to P2
-        #ifdef ROLE_p0
-            co_await send_val(p2_sock, 0);
-        #endif
+        // Signal end of protocol to P2 and wait for the triples still in flight
+        co_await mpc.triplePool().finish();
+        mpc.printRounds(cout, role);
+        mpc.triplePool().printStats(cout, role);
 
         // New: reconstruct final V at P0 (for verification only)
         #ifdef ROLE_p0
@@ -208,10 +248,11 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             ofstream vout("mpc_V_results.txt", ios::trunc);
             if (!vout.is_open()) throw runtime_error("Could not open mpc_V_results.txt for writing");
             for (int idx = 0; idx < n; ++idx) {
-                Share peer_row = co_await recv_vec(peer_sock, k);
-                Share recon = v_shares[idx] + peer_row;
+                net.expect(0, k);
+                co_await net.recv(1);
+                const ll* peer_row = net.incoming(0);
                 vout << idx;
-                for (auto v : recon.data) vout << " " << v;
+                for (int d = 0; d < k; ++d) vout << " " << Ring::add(v_shares(idx, d), peer_row[d]);
                 vout << "\n";
             }
             vout.close();
@@ -222,7 +263,8 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             ll tag = co_await recv_val(peer_sock);
             if (tag != -1) throw runtime_error("Unexpected tag while dumping V shares");
             for (int idx = 0; idx < n; ++idx) {
-                co_await send_vec(peer_sock, v_shares[idx]);
+                copy(v_shares.rowData(idx), v_shares.rowData(idx) + k, net.outgoing(0, k));
+                co_await net.send(1);
             }
         }
         #endif
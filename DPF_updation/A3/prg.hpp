@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DPF_HAVE_AESNI 1
+#endif
+
+typedef uint64_t u64;
+
+// structure to hold the left and right child seeds and flags
+struct child{
+    u64 leftSeed, rightSeed;
+    bool leftFlag, rightFlag;
+};
+
+// A PRG backend is any type with a static `child expand(u64 seed)` for inner
+// nodes and a static `void convert(u64 seed, u64 out[2])` that stretches a leaf
+// seed into 128 output bits. Key generation and evaluation must use the same backend.
+
+// Reference backend: a fresh mt19937_64 per node (slow, seeding fills 312 words of state)
+struct MT19937PRG{
+    static constexpr const char* name = "mt19937_64";
+    static constexpr uint32_t id = 1;   // recorded in binary key files
+
+    static child expand(u64 seed){
+        std::mt19937_64 prng(seed);
+        child next;
+        next.leftSeed = prng();
+        next.rightSeed = prng();
+        next.leftFlag = (prng() & 1ULL);
+        next.rightFlag = (prng() & 1ULL);
+        return next;
+    }
+
+    // words 5 and 6 of the same stream, so leaf output never repeats child seeds
+    static void convert(u64 seed, u64 out[2]){
+        std::mt19937_64 prng(seed);
+        prng.discard(4);
+        out[0] = prng();
+        out[1] = prng();
+    }
+};
+
+#ifdef DPF_HAVE_AESNI
+// Fixed-key AES-128 in Matyas-Meyer-Oseas style: H(x) = AES_k(x) ^ x.
+// Left child comes from the block (seed, 0) and right child from (seed, 1);
+// the low word is the child seed and bit 0 of the high word is its flag.
+struct AESPRG{
+    static constexpr const char* name = "aes-ni (fixed-key MMO)";
+    static constexpr uint32_t id = 2;
+
+    struct RoundKeys{ __m128i k[11]; };
+
+    __attribute__((target("aes")))
+    static __m128i expandStep(__m128i key, __m128i assist){
+        assist = _mm_shuffle_epi32(assist, 0xff);
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        return _mm_xor_si128(key, assist);
+    }
+
+    __attribute__((target("aes")))
+    static RoundKeys schedule(){
+        if(!__builtin_cpu_supports("aes"))
+            throw std::runtime_error("AES-NI not available on this CPU; rebuild with -DDPF_PRG_MT19937");
+        RoundKeys rk;
+        // public fixed key, the same for every party
+        rk.k[0] = _mm_set_epi64x(0x0f1e2d3c4b5a6978LL, 0x8796a5b4c3d2e1f0LL);
+        rk.k[1]  = expandStep(rk.k[0], _mm_aeskeygenassist_si128(rk.k[0], 0x01));
+        rk.k[2]  = expandStep(rk.k[1], _mm_aeskeygenassist_si128(rk.k[1], 0x02));
+        rk.k[3]  = expandStep(rk.k[2], _mm_aeskeygenassist_si128(rk.k[2], 0x04));
+        rk.k[4]  = expandStep(rk.k[3], _mm_aeskeygenassist_si128(rk.k[3], 0x08));
+        rk.k[5]  = expandStep(rk.k[4], _mm_aeskeygenassist_si128(rk.k[4], 0x10));
+        rk.k[6]  = expandStep(rk.k[5], _mm_aeskeygenassist_si128(rk.k[5], 0x20));
+        rk.k[7]  = expandStep(rk.k[6], _mm_aeskeygenassist_si128(rk.k[6], 0x40));
+        rk.k[8]  = expandStep(rk.k[7], _mm_aeskeygenassist_si128(rk.k[7], 0x80));
+        rk.k[9]  = expandStep(rk.k[8], _mm_aeskeygenassist_si128(rk.k[8], 0x1b));
+        rk.k[10] = expandStep(rk.k[9], _mm_aeskeygenassist_si128(rk.k[9], 0x36));
+        return rk;
+    }
+
+    static const RoundKeys& roundKeys(){
+        static const RoundKeys rk = schedule();
+        return rk;
+    }
+
+    __attribute__((target("aes")))
+    static child expand(u64 seed){
+        const RoundKeys& rk = roundKeys();
+        __m128i x0 = _mm_set_epi64x(0, (long long)seed);
+        __m128i x1 = _mm_set_epi64x(1, (long long)seed);
+
+        // both blocks go through the rounds together so the AES units stay busy
+        __m128i y0 = _mm_xor_si128(x0, rk.k[0]);
+        __m128i y1 = _mm_xor_si128(x1, rk.k[0]);
+        for(int r = 1; r < 10; ++r){
+            y0 = _mm_aesenc_si128(y0, rk.k[r]);
+            y1 = _mm_aesenc_si128(y1, rk.k[r]);
+        }
+        y0 = _mm_xor_si128(_mm_aesenclast_si128(y0, rk.k[10]), x0);
+        y1 = _mm_xor_si128(_mm_aesenclast_si128(y1, rk.k[10]), x1);
+
+        child next;
+        next.leftSeed = (u64)_mm_cvtsi128_si64(y0);
+        next.rightSeed = (u64)_mm_cvtsi128_si64(y1);
+        next.leftFlag = (_mm_cvtsi128_si64(_mm_unpackhi_epi64(y0, y0)) & 1LL);
+        next.rightFlag = (_mm_cvtsi128_si64(_mm_unpackhi_epi64(y1, y1)) & 1LL);
+        return next;
+    }
+
+    // leaf output is the whole MMO block of (seed, 2)
+    __attribute__((target("aes")))
+    static void convert(u64 seed, u64 out[2]){
+        const RoundKeys& rk = roundKeys();
+        __m128i x = _mm_set_epi64x(2, (long long)seed);
+        __m128i y = _mm_xor_si128(x, rk.k[0]);
+        for(int r = 1; r < 10; ++r) y = _mm_aesenc_si128(y, rk.k[r]);
+        y = _mm_xor_si128(_mm_aesenclast_si128(y, rk.k[10]), x);
+        out[0] = (u64)_mm_cvtsi128_si64(y);
+        out[1] = (u64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(y, y));
+    }
+};
+#endif
+
+// AES-NI is the default on x86; -DDPF_PRG_MT19937 selects the reference backend
+#if defined(DPF_HAVE_AESNI) && !defined(DPF_PRG_MT19937)
+using DefaultPRG = AESPRG;
+#else
+using DefaultPRG = MT19937PRG;
+#endif
+
+// child PRG; ctr_base is the level, kept for callers that want level separation
+inline child Expand(u64 seed, u64 ctr_base = 0){
+    (void)ctr_base;
+    return DefaultPRG::expand(seed);
+}
+
+// leaf PRG: 128 output bits from a seed at the bottom of the (early-terminated) tree
+inline void ConvertLeaf(u64 seed, u64 out[2]){
+    DefaultPRG::convert(seed, out);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "shares.hpp"
+#include "utility.hpp"
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SEED_PRG_HAVE_AESNI 1
+#endif
+
+// Seed-compressed triple shares: P2 draws P0's share of a triple from a short
+// seed and sends P0 only the seed; P0 runs the same expansion locally. P1's
+// share is the triple minus P0's, so P1 still receives it in full.
+
+// 128-bit PRG seed, what P2 sends P0 in place of its triple shares
+struct TripleSeed {
+    uint64_t w[2];
+};
+
+inline TripleSeed freshTripleSeed() {
+    static std::random_device rd;
+    TripleSeed s;
+    for (auto& w : s.w) w = ((uint64_t)rd() << 32) | rd();
+    return s;
+}
+
+// Stream of 64-bit words from a seed: AES-128 in counter mode keyed by the
+// seed (AES-NI), or mt19937_64 seeded with it when built with -DDPF_PRG_MT19937
+// or off x86. P2 and P0 must be built with the same choice.
+class SeedPRG {
+public:
+    explicit SeedPRG(const TripleSeed& seed) {
+#if defined(SEED_PRG_HAVE_AESNI) && !defined(DPF_PRG_MT19937)
+        schedule(seed);
+#else
+        std::seed_seq seq{(uint32_t)seed.w[0], (uint32_t)(seed.w[0] >> 32),
+                          (uint32_t)seed.w[1], (uint32_t)(seed.w[1] >> 32)};
+        mt.seed(seq);
+#endif
+    }
+
+    uint64_t next() {
+        if (pos == kBufWords) refill();
+        return buf[pos++];
+    }
+
+    // ring element (ring.hpp)
+    ll nextMod() { return (ll)Ring::fromWord(next()); }
+
+private:
+    static constexpr int kBlocks = 8;              // AES blocks per refill, pipelined
+    static constexpr int kBufWords = 2 * kBlocks;
+
+#if defined(SEED_PRG_HAVE_AESNI) && !defined(DPF_PRG_MT19937)
+    __attribute__((target("aes")))
+    static __m128i expandStep(__m128i key, __m128i assist) {
+        assist = _mm_shuffle_epi32(assist, 0xff);
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        return _mm_xor_si128(key, assist);
+    }
+
+    __attribute__((target("aes")))
+    void schedule(const TripleSeed& seed) {
+        if (!__builtin_cpu_supports("aes"))
+            throw std::runtime_error("AES-NI not available on this CPU; rebuild with -DDPF_PRG_MT19937");
+        rk[0]  = _mm_set_epi64x((long long)seed.w[1], (long long)seed.w[0]);
+        rk[1]  = expandStep(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+        rk[2]  = expandStep(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+        rk[3]  = expandStep(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+        rk[4]  = expandStep(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+        rk[5]  = expandStep(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+        rk[6]  = expandStep(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+        rk[7]  = expandStep(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+        rk[8]  = expandStep(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+        rk[9]  = expandStep(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+        rk[10] = expandStep(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+    }
+
+    __attribute__((target("aes")))
+    void refill() {
+        __m128i y[kBlocks];
+        for (int b = 0; b < kBlocks; ++b) y[b] = _mm_xor_si128(_mm_set_epi64x(0, (long long)ctr++), rk[0]);
+        for (int r = 1; r < 10; ++r)
+            for (int b = 0; b < kBlocks; ++b) y[b] = _mm_aesenc_si128(y[b], rk[r]);
+        for (int b = 0; b < kBlocks; ++b) _mm_storeu_si128((__m128i*)&buf[2 * b], _mm_aesenclast_si128(y[b], rk[10]));
+        pos = 0;
+    }
+
+    __m128i rk[11];
+    uint64_t ctr = 0;
+#else
+    void refill() {
+        for (auto& w : buf) w = mt();
+        pos = 0;
+    }
+
+    std::mt19937_64 mt;
+#endif
+
+    uint64_t buf[kBufWords];
+    int pos = kBufWords;
+};
+
+// P0's shares of a correlation (ScalarVecTriple, InnerProductTriple, MatrixTriple):
+// every field is drawn from the seed in wire order
+template <typename Triple>
+inline void expandShares(const TripleSeed& seed, ll rows, ll cols, Triple& t) {
+    SeedPRG prg(seed);
+    t.resize(rows, cols);
+    for (const auto& buf : t.wireBuffers()) {
+        ll* v = (ll*)buf.data();
+        for (size_t i = 0; i < buf.size() / sizeof(ll); ++i) v[i] = prg.nextMod();
+    }
+}
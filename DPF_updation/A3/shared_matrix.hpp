@@ -0,0 +1,89 @@
+#pragma once
+#include "shares.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// Additive shares of a rows x cols matrix (users U or items V) in one
+// contiguous, 64-byte-aligned, row-major buffer of Ring::Storage elements:
+// 4 bytes per element for p = 1e9+7 instead of a heap-allocated vector<ll>
+// per row. Rows are handed out as views that read and write the buffer in place.
+
+// One row of a SharedMatrix; converts to and from Share by copy
+template <typename Elem>
+class SharedRowView {
+public:
+    SharedRowView(Elem* p, size_t n) : p(p), n(n) {}
+
+    // views are not rebound by assignment: assigning a Share writes the row
+    SharedRowView& operator=(const SharedRowView&) = delete;
+
+    int size() const { return (int)n; }
+    ll operator[](size_t i) const { return (ll)p[i]; }
+    Elem* data() const { return p; }
+
+    operator Share() const { return Share(vector<ll>(p, p + n)); }
+
+    const SharedRowView& operator=(const Share& s) const {
+        if ((size_t)s.size() != n) throw invalid_argument("Vectors must be of same size");
+        return assign(s.data.data());
+    }
+
+    // copies n elements from src
+    const SharedRowView& assign(const ll* src) const {
+        static_assert(!is_const_v<Elem>, "row is read-only");
+        for (size_t i = 0; i < n; ++i) p[i] = (Elem)src[i];
+        return *this;
+    }
+
+    const SharedRowView& operator+=(const Share& s) const {
+        static_assert(!is_const_v<Elem>, "row is read-only");
+        if ((size_t)s.size() != n) throw invalid_argument("Vectors must be of same size");
+        ringAddInto(p, s.data.data(), n);
+        return *this;
+    }
+
+private:
+    Elem* p;
+    size_t n;
+};
+
+class SharedMatrix {
+public:
+    using Elem = Ring::Storage;
+    static constexpr size_t kAlign = 64;
+
+    SharedMatrix() = default;
+
+    // all elements zero
+    SharedMatrix(size_t rows, size_t cols) : nRows(rows), nCols(cols) {
+        size_t bytes = (rows * cols * sizeof(Elem) + kAlign - 1) / kAlign * kAlign;
+        if (bytes == 0) return;
+        buf.reset(static_cast<Elem*>(std::aligned_alloc(kAlign, bytes)));
+        if (!buf) throw bad_alloc();
+        memset(buf.get(), 0, bytes);
+    }
+
+    size_t rows() const { return nRows; }
+    size_t cols() const { return nCols; }
+    size_t bytes() const { return nRows * nCols * sizeof(Elem); }
+
+    SharedRowView<Elem> operator[](size_t r) { return {rowData(r), nCols}; }
+    SharedRowView<const Elem> operator[](size_t r) const { return {rowData(r), nCols}; }
+    ll operator()(size_t r, size_t c) const { return (ll)buf[r * nCols + c]; }
+
+    Elem* rowData(size_t r) { return buf.get() + r * nCols; }
+    const Elem* rowData(size_t r) const { return buf.get() + r * nCols; }
+
+private:
+    struct FreeAligned {
+        void operator()(Elem* p) const { std::free(p); }
+    };
+
+    size_t nRows = 0, nCols = 0;
+    unique_ptr<Elem[], FreeAligned> buf;
+};
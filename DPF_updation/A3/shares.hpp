@@ -1,11 +1,15 @@
 #pragma once  //this is to ensure the file is called once (for security)
+#include<array>
+#include<string>
 #include<vector>
 #include<cstdint>
+#include<cstdlib>
 #include<numeric>
 #include<stdexcept>
 #include "common.hpp"
-
-const int MOD = 1000000007;
+#include "ring.hpp"
+#include "share_kernels.hpp"
+#include "wire_codec.hpp"
 
 typedef long long int ll;
 using namespace std;
@@ -18,7 +22,7 @@ struct Share{
     Share(vector<ll> d): data(move(d)) {}
 
     void randomizer(){
-        for(auto &val: data) val = random_uint32()%MOD; //random value generation
+        for(auto &val: data) val = (ll)Ring::fromWord(random_uint64()); //random ring element
     }
 
     int size() const{
@@ -27,34 +31,96 @@ struct Share{
     }
 };
 
-//vector addition, subtraction, multiplication
-inline Share operator+(const Share &a, const Share &b){
+//vector addition, subtraction, multiplication, in place and by value (share_kernels.hpp)
+inline Share& operator+=(Share &a, const Share &b){
     if(a.size() != b.size()) throw invalid_argument("Vectors must be of same size");
-    Share result(a.size());
-    for(size_t i=0; i<a.size(); i++){
-        result.data[i] = (a.data[i] + b.data[i]) % MOD;
-    }
-    return result;
+    ringAddInto(a.data.data(), b.data.data(), a.data.size());
+    return a;
 }
 
-inline Share operator-(const Share &a, const Share &b){
+inline Share& operator-=(Share &a, const Share &b){
     if(a.size() != b.size()) throw invalid_argument("Vectors must be of same size");
-    Share result(a.size());
-    for(size_t i=0; i<a.size(); i++){
-        result.data[i] = (a.data[i] - b.data[i] + MOD) % MOD;
-    }
-    return result;
+    ringSubInto(a.data.data(), b.data.data(), a.data.size());
+    return a;
 }
 
-inline Share operator*(const Share &a, const Share &b){
+inline Share& operator*=(Share &a, const Share &b){
     if(a.size() != b.size()) throw invalid_argument("Vectors must be of same size");
-    Share result(a.size());
-    for(size_t i=0; i<a.size(); i++){
-        result.data[i] = (a.data[i] *b.data[i])%MOD;
+    ringMulInto(a.data.data(), b.data.data(), a.data.size());
+    return a;
+}
+
+inline Share operator+(Share a, const Share &b){ a += b; return a; }
+inline Share operator-(Share a, const Share &b){ a -= b; return a; }
+inline Share operator*(Share a, const Share &b){ a *= b; return a; }
+
+// Header P0 sends to P2 before every batch of correlated randomness
+enum TripleKind : ll {
+    TRIPLE_END = 0,            // session finished
+    TRIPLE_SCALAR_VEC = 1,     // ScalarVecTriple of length cols
+    TRIPLE_MATRIX = 2,         // MatrixTriple of rows x cols
+    TRIPLE_INNER_PRODUCT = 3,  // InnerProductTriple of length cols
+    TRIPLE_SEEDED = 0x100,     // flag on P2's reply header: the payload is a TripleSeed
+                               // from which P0 expands its shares (seed_prg.hpp)
+};
+
+struct TripleRequest{
+    ll kind, rows, cols;
+};
+
+// First message on a connection to P2: the party's role (0 = P0, 1 = P1) and the
+// session it belongs to. P2 pairs the two connections of a session by its ID.
+struct DealerHello{
+    uint64_t role, session;
+};
+
+// session ID for the handshake with P2: SESSION_ID if set, otherwise 0
+inline uint64_t sessionIdFromEnv() {
+    const char* env = getenv("SESSION_ID");
+    return env ? strtoull(env, nullptr, 10) : 0;
+}
+
+// Shares of the correlations P2 deals, one type per shape mpc.hpp multiplies.
+// On the wire each is one WIRE_TRIPLE frame of its fields in declaration order
+// (wire_codec.hpp).
+
+// scalar x vector: c[i] = a * b[i]
+struct ScalarVecTriple{
+    ll a = 0;
+    vector<ll> b, c;
+    void resize(ll rows, ll cols) { (void)rows; b.resize(cols); c.resize(cols); }
+    auto wireBuffers() { return std::array<boost::asio::mutable_buffer, 3>{
+        boost::asio::buffer(&a, sizeof(a)), boost::asio::buffer(b), boost::asio::buffer(c)}; }
+};
+
+// inner product: c = <a, b>
+struct InnerProductTriple{
+    vector<ll> a, b;
+    ll c = 0;
+    void resize(ll rows, ll cols) { (void)rows; a.resize(cols); b.resize(cols); }
+    auto wireBuffers() { return std::array<boost::asio::mutable_buffer, 3>{
+        boost::asio::buffer(a), boost::asio::buffer(b), boost::asio::buffer(&c, sizeof(c))}; }
+};
+
+// vector x matrix: C = a^T B, with a (rows), B (rows x cols, row-major), C (cols)
+struct MatrixTriple{
+    vector<ll> a, B, C;
+    void resize(ll rows, ll cols) { a.resize(rows); B.resize(rows * cols); C.resize(cols); }
+    auto wireBuffers() { return std::array<boost::asio::mutable_buffer, 3>{
+        boost::asio::buffer(a), boost::asio::buffer(B), boost::asio::buffer(C)}; }
+};
+
+// ring elements in one correlation of the given shape
+inline size_t tripleWords(ll kind, ll rows, ll cols) {
+    switch (kind) {
+        case TRIPLE_SCALAR_VEC:    return (size_t)(1 + 2 * cols);
+        case TRIPLE_INNER_PRODUCT: return (size_t)(2 * cols + 1);
+        case TRIPLE_MATRIX:        return (size_t)(rows + rows * cols + cols);
+        default: throw invalid_argument("unknown triple kind " + to_string(kind));
     }
-    return result;
 }
 
-struct BeaverTriple{
-    ll a, b, c;
-};
\ No newline at end of file
+// bytes of one correlation of the given shape on the wire, as one frame
+inline size_t tripleWireBytes(ll kind, ll rows, ll cols) {
+    return wireFrameBytes(tripleWords(kind, rows, cols));
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool: every worker owns a deque, pops its own tasks from
+// the back and steals from the front of the others once it runs dry.
+// run() hands out a batch of tasks and blocks until all of them have finished;
+// the calling thread works on the batch as well.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads = std::thread::hardware_concurrency())
+        : queues(std::max(1u, threads)) {
+        for (unsigned w = 1; w < queues.size(); ++w)
+            workers.emplace_back([this, w] { workerLoop(w); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    void run(std::vector<std::function<void()>>& tasks) {
+        if (tasks.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending = tasks.size();
+            firstError = nullptr;
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                Queue& q = queues[i % queues.size()];
+                std::lock_guard<std::mutex> qlock(q.mtx);
+                q.tasks.push_back(std::move(tasks[i]));
+            }
+            ++generation;
+        }
+        wake.notify_all();
+
+        drain(0);
+        std::unique_lock<std::mutex> lock(mtx);
+        done.wait(lock, [this] { return pending == 0; });
+        tasks.clear();
+        if (firstError) std::rethrow_exception(firstError);
+    }
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(unsigned self, std::function<void()>& task) {
+        {
+            Queue& own = queues[self];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& victim = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(unsigned self) {
+        std::function<void()> task;
+        while (take(self, task)) {
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!firstError) firstError = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--pending == 0) done.notify_all();
+        }
+    }
+
+    void workerLoop(unsigned self) {
+        size_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain(self);
+        }
+    }
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable wake, done;
+    size_t pending = 0;
+    size_t generation = 0;
+    bool stopping = false;
+    std::exception_ptr firstError;
+};
+
+// Thread count for DPF evaluation: DPF_THREADS if set, otherwise all hardware threads
+inline unsigned dpfThreadsFromEnv() {
+    const char* env = std::getenv("DPF_THREADS");
+    if (env && std::atoi(env) > 0) return (unsigned)std::atoi(env);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
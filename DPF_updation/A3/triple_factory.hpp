@@ -0,0 +1,327 @@
+#pragma once
+#include "common.hpp"
+#include "shares.hpp"
+#include "utility.hpp"
+#include "seed_prg.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// Triple generation for P2, run by worker threads ahead of demand.
+//
+// Each generator fills t1 = (correlation - t0), where t0 (P0's shares) is
+// expanded from `seed`, so P0 can be sent the seed alone. The correlation's own
+// randomness comes from the worker's SeedPRG (AES-CTR, 8 blocks per refill)
+// instead of the shared, mutex-guarded mt19937 behind random_uint32().
+
+// scalar x vector: one a, cols b's, c[i] = a * b[i] (matches scalarVecProd)
+inline void scalarVecTriple(ll rows, ll cols, const TripleSeed& seed, SeedPRG& rng, ScalarVecTriple& t0, ScalarVecTriple& t1) {
+    expandShares(seed, rows, cols, t0);
+    t1.resize(rows, cols);
+
+    ll a = rng.nextMod();
+    t1.a = subm(a, t0.a);
+    for(ll i=0; i<cols; ++i) {
+        ll b = rng.nextMod();
+        t1.b[i] = subm(b, t0.b[i]);
+        t1.c[i] = subm(mulm(a, b), t0.c[i]);
+    }
+}
+
+// inner product: cols a's and b's, c = <a, b> (matches MPC_DOTPRODUCT)
+inline void innerProductTriple(ll rows, ll cols, const TripleSeed& seed, SeedPRG& rng, InnerProductTriple& t0, InnerProductTriple& t1) {
+    expandShares(seed, rows, cols, t0);
+    t1.resize(rows, cols);
+
+    ll c = 0;
+    for(ll i=0; i<cols; ++i) {
+        ll a = rng.nextMod();
+        ll b = rng.nextMod();
+        c = addm(c, mulm(a, b));
+        t1.a[i] = subm(a, t0.a[i]);
+        t1.b[i] = subm(b, t0.b[i]);
+    }
+    t1.c = subm(c, t0.c);
+}
+
+// vector x matrix: a (rows), B (rows x cols), C = a^T B
+inline void matrixTriple(ll rows, ll cols, const TripleSeed& seed, SeedPRG& rng, MatrixTriple& t0, MatrixTriple& t1) {
+    expandShares(seed, rows, cols, t0);
+    t1.resize(rows, cols);
+
+    vector<ll> C(cols, 0);
+    for(ll r=0; r<rows; ++r) {
+        ll a = rng.nextMod();
+        t1.a[r] = subm(a, t0.a[r]);
+        for(ll d=0; d<cols; ++d) {
+            ll b = rng.nextMod();
+            C[d] = addm(C[d], mulm(a, b));
+            t1.B[r*cols + d] = subm(b, t0.B[r*cols + d]);
+        }
+    }
+    for(ll d=0; d<cols; ++d) t1.C[d] = subm(C[d], t0.C[d]);
+}
+
+// One dealt correlation in wire format: P0's seed, the WIRE_TRIPLE frame of P1's
+// shares and, only when P0 is sent its shares in full, the frame of P0's shares.
+// Workers pack the frames, so the network coroutine only writes them.
+struct DealtTriple {
+    TripleSeed seed;
+    vector<uint8_t> p0, p1;
+};
+
+// fixed-capacity FIFO; the factory guards it with its own mutex
+template <typename T>
+class BoundedRing {
+public:
+    explicit BoundedRing(size_t capacity) : slots(capacity) {}
+
+    size_t size() const { return count; }
+    size_t capacity() const { return slots.size(); }
+    bool full() const { return count == slots.size(); }
+
+    void push(T item) {
+        slots[(head + count) % slots.size()] = std::move(item);
+        ++count;
+    }
+
+    T pop() {
+        T item = std::move(slots[head]);
+        head = (head + 1) % slots.size();
+        --count;
+        return item;
+    }
+
+private:
+    vector<T> slots;
+    size_t head = 0, count = 0;
+};
+
+const size_t kFactoryDepth = 32;             // triples kept ready per shape
+const size_t kFactoryBytes = 128ULL << 20;   // memory cap per shape
+
+// Worker count for the factory: P2_THREADS if set, otherwise all hardware threads
+inline unsigned factoryThreadsFromEnv() {
+    const char* env = std::getenv("P2_THREADS");
+    if (env && std::atoi(env) > 0) return (unsigned)std::atoi(env);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Pipelined triple factory shared by all sessions (party pairs) of a dealer.
+// The first request for a shape registers it in the session; from then on the
+// workers keep that shape's ring full, and the network coroutine only pops
+// finished triples and writes them. CPU is shared fairly: a worker always fills
+// the session that has been given the least generation work (in wire bytes)
+// among those with a free slot, then that session's shapes round-robin.
+class TripleFactory {
+    using ShapeKey = tuple<ll, ll, ll>;
+
+    struct Shape {
+        TripleRequest req;
+        BoundedRing<DealtTriple> ring;
+        size_t inProgress = 0;   // being generated by workers
+        Shape(const TripleRequest& req, size_t capacity) : req(req), ring(capacity) {}
+    };
+
+public:
+    // One party pair's prefetch queues. Everything but `ready` is guarded by the
+    // factory mutex; `ready` is only touched on the io thread.
+    class Session {
+    public:
+        Session(uint64_t id, boost::asio::any_io_executor ex)
+            : id(id), ready(ex, boost::asio::steady_timer::time_point::max()),
+              start(chrono::steady_clock::now()) {}
+
+        const uint64_t id;
+
+    private:
+        friend class TripleFactory;
+
+        // caller holds the factory mutex
+        bool hasFreeSlot() const {
+            for (const Shape* s : order)
+                if (s->ring.size() + s->inProgress < s->ring.capacity()) return true;
+            return false;
+        }
+
+        // caller holds the factory mutex: next shape (round-robin) with a free slot
+        Shape* nextToFill() {
+            for (size_t i = 0; i < order.size(); ++i) {
+                Shape* s = order[(cursor + i) % order.size()];
+                if (s->ring.size() + s->inProgress < s->ring.capacity()) {
+                    cursor = (cursor + i + 1) % order.size();
+                    return s;
+                }
+            }
+            return nullptr;
+        }
+
+        boost::asio::steady_timer ready;
+        chrono::steady_clock::time_point start;
+        map<ShapeKey, unique_ptr<Shape>> shapes;
+        vector<Shape*> order;
+        size_t cursor = 0;
+        uint64_t work = 0;   // wire bytes generated or being generated for this session
+        uint64_t generated = 0, taken = 0, waits = 0, bytesTaken = 0;
+    };
+
+    TripleFactory(boost::asio::any_io_executor ex, unsigned threads, bool compressed)
+        : ex(ex), compressed(compressed) {
+        // worker PRGs are keyed here: random_device is not shared across threads
+        for (unsigned w = 0; w < max(1u, threads); ++w) {
+            TripleSeed key = freshTripleSeed();
+            workers.emplace_back([this, key] { workerLoop(key); });
+        }
+    }
+
+    ~TripleFactory() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    TripleFactory(const TripleFactory&) = delete;
+    TripleFactory& operator=(const TripleFactory&) = delete;
+
+    unsigned threads() const { return (unsigned)workers.size(); }
+
+    shared_ptr<Session> openSession(uint64_t id) {
+        auto s = make_shared<Session>(id, ex);
+        lock_guard<mutex> lock(mtx);
+        // a new session starts level with the least-served one, so it neither
+        // starves the others nor waits for them to catch up with its zero
+        uint64_t least = UINT64_MAX;
+        for (auto& o : sessions) least = min(least, o->work);
+        s->work = sessions.empty() ? 0 : least;
+        sessions.push_back(s);
+        return s;
+    }
+
+    // stops generating for the session and drops its queued triples
+    void closeSession(const shared_ptr<Session>& s) {
+        lock_guard<mutex> lock(mtx);
+        sessions.erase(remove(sessions.begin(), sessions.end(), s), sessions.end());
+        for (auto& kv : s->shapes) kv.second->ring = BoundedRing<DealtTriple>(kv.second->ring.capacity());
+    }
+
+    // next triple of the request's shape for the session; waits (without
+    // blocking the io thread) only when the workers have not caught up
+    awaitable<DealtTriple> take(Session& s, const TripleRequest& req) {
+        tripleWireBytes(req.kind, req.rows, req.cols);   // rejects unknown kinds
+        bool waited = false;
+        for (;;) {
+            {
+                lock_guard<mutex> lock(mtx);
+                Shape& sh = shapeFor(s, req);
+                if (sh.ring.size()) {
+                    DealtTriple d = sh.ring.pop();
+                    ++s.taken;
+                    s.bytesTaken += tripleWireBytes(req.kind, req.rows, req.cols);
+                    if (waited) ++s.waits;
+                    wake.notify_one();   // a slot just freed up
+                    co_return d;
+                }
+            }
+            waited = true;
+            boost::system::error_code ec;
+            s.ready.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await s.ready.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+    // per-session throughput since the session was opened
+    void printStats(ostream& os, const Session& s) {
+        lock_guard<mutex> lock(mtx);
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - s.start).count();
+        os << "P2: session " << s.id << " triples=" << s.taken << " generated=" << s.generated
+           << " waits=" << s.waits << " in " << secs << " s (" << (secs > 0 ? s.taken / secs : 0)
+           << " triples/s, " << (secs > 0 ? s.bytesTaken / secs / 1e6 : 0) << " MB/s of P1 shares)" << endl;
+    }
+
+private:
+    // caller holds mtx
+    Shape& shapeFor(Session& s, const TripleRequest& req) {
+        ShapeKey key{req.kind, req.rows, req.cols};
+        auto it = s.shapes.find(key);
+        if (it == s.shapes.end()) {
+            size_t bytes = tripleWireBytes(req.kind, req.rows, req.cols);
+            size_t depth = max<size_t>(1, min(kFactoryDepth, kFactoryBytes / max<size_t>(bytes, 1)));
+            it = s.shapes.emplace(key, make_unique<Shape>(req, depth)).first;
+            s.order.push_back(it->second.get());
+            wake.notify_all();
+        }
+        return *it->second;
+    }
+
+    // caller holds mtx: the least-served session with a free slot, and its next shape
+    pair<shared_ptr<Session>, Shape*> nextToFill() {
+        shared_ptr<Session> best;
+        for (auto& s : sessions)
+            if ((!best || s->work < best->work) && s->hasFreeSlot()) best = s;
+        if (!best) return {nullptr, nullptr};
+        return {best, best->nextToFill()};
+    }
+
+    template <typename Triple>
+    void dealWith(void (*generate)(ll, ll, const TripleSeed&, SeedPRG&, Triple&, Triple&),
+                  const TripleRequest& req, SeedPRG& rng, DealtTriple& d) {
+        Triple t0, t1;
+        generate(req.rows, req.cols, d.seed, rng, t0, t1);
+        if (!compressed) d.p0 = encodeBuffers(WIRE_TRIPLE, t0.wireBuffers());
+        d.p1 = encodeBuffers(WIRE_TRIPLE, t1.wireBuffers());
+    }
+
+    DealtTriple deal(const TripleRequest& req, SeedPRG& rng) {
+        DealtTriple d;
+        d.seed = TripleSeed{{rng.next(), rng.next()}};
+        if (req.kind == TRIPLE_SCALAR_VEC) dealWith(scalarVecTriple, req, rng, d);
+        else if (req.kind == TRIPLE_INNER_PRODUCT) dealWith(innerProductTriple, req, rng, d);
+        else dealWith(matrixTriple, req, rng, d);
+        return d;
+    }
+
+    void workerLoop(TripleSeed key) {
+        SeedPRG rng(key);
+        unique_lock<mutex> lock(mtx);
+        for (;;) {
+            pair<shared_ptr<Session>, Shape*> next;
+            wake.wait(lock, [&] { return stopping || (next = nextToFill()).second != nullptr; });
+            if (stopping) return;
+            auto [s, sh] = next;
+            TripleRequest req = sh->req;
+            uint64_t cost = tripleWireBytes(req.kind, req.rows, req.cols);
+            ++sh->inProgress;
+            s->work += cost;
+            lock.unlock();
+            DealtTriple d = deal(req, rng);
+            lock.lock();
+            --sh->inProgress;
+            sh->ring.push(std::move(d));
+            ++s->generated;
+            boost::asio::post(ex, [s] { s->ready.cancel(); });
+        }
+    }
+
+    boost::asio::any_io_executor ex;
+    bool compressed;
+
+    mutex mtx;
+    condition_variable wake;
+    bool stopping = false;
+    vector<shared_ptr<Session>> sessions;   // open sessions
+    vector<thread> workers;
+};
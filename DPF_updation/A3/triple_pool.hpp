@@ -0,0 +1,270 @@
+#pragma once
+#include "common.hpp"
+#include "shares.hpp"
+#include "seed_prg.hpp"
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// Offline/online split for the correlated randomness dealt by P2.
+//
+// A background coroutine reads everything P2 sends (request header + payload)
+// into one queue per shape (kind, rows, cols), so the online protocol takes
+// triples without a round trip to P2. Only P0 asks for triples: when a shape's
+// queued + in-flight count falls to its low watermark, P0 requests enough to
+// reach the shape's target depth, but no more than the run's expected demand
+// for the shape (given to prefetch) still outstanding. P2 echoes every header to both parties, so
+// P1's queues receive the same triples in the same order, and since both
+// parties run the same protocol they also take them in the same order.
+// When P2 runs seed-compressed, P0's payloads are TripleSeeds that the reader
+// expands into P0's shares. Shares sent in full come as one bit-packed
+// WIRE_TRIPLE frame (wire_codec.hpp).
+
+const size_t kTriplePoolDepth = 16;          // target triples queued per shape
+const size_t kTriplePoolBytes = 64ULL << 20; // memory cap per shape (large matrix triples)
+
+struct TriplePoolStats {
+    uint64_t takes = 0;      // triples handed to the online protocol
+    uint64_t hits = 0;       // ... that were already queued
+    uint64_t misses = 0;     // ... that the protocol had to wait for (pool exhausted)
+    uint64_t waitUs = 0;     // total time spent waiting on misses
+    uint64_t requested = 0;  // triples requested from P2 (P0 only)
+    uint64_t received = 0;   // triples read from P2
+    uint64_t bytesIn = 0;    // bytes read from P2, headers included
+    uint64_t peakQueued = 0; // most triples queued at once, all shapes
+};
+
+// Held by shared_ptr: the reader and writer coroutines keep the pool alive
+// until their pending socket operations complete, even if the protocol unwinds early.
+class TriplePool : public enable_shared_from_this<TriplePool> {
+public:
+    explicit TriplePool(tcp::socket& p2)
+        : p2_sock(p2), arrived(p2.get_executor(), boost::asio::steady_timer::time_point::max()) {}
+
+    // starts the background reader; call once, before the first take
+    void start() {
+        co_spawn(p2_sock.get_executor(), readLoop(shared_from_this()), detached);
+    }
+
+    TriplePool(const TriplePool&) = delete;
+    TriplePool& operator=(const TriplePool&) = delete;
+
+    // P0: fill a shape up to its target depth ahead of its first use, and never
+    // request more than the `expected` takes of it the run will make; a take past
+    // that is served on demand (no-op on P1)
+    void prefetch(ll kind, ll rows, ll cols, size_t expected) {
+        ShapeQueue& q = queueFor(kind, rows, cols);
+        q.budget = expected;
+        refill(kind, rows, cols, q);
+    }
+
+    // one a, cols b's and c's (TRIPLE_SCALAR_VEC)
+    awaitable<ScalarVecTriple> takeScalarVec(ll cols) {
+        PooledTriple t = co_await take(TRIPLE_SCALAR_VEC, 1, cols);
+        co_return std::move(t.scalarVec);
+    }
+
+    // cols a's and b's, one c (TRIPLE_INNER_PRODUCT)
+    awaitable<InnerProductTriple> takeInnerProduct(ll cols) {
+        PooledTriple t = co_await take(TRIPLE_INNER_PRODUCT, 1, cols);
+        co_return std::move(t.innerProduct);
+    }
+
+    // a (rows), B (rows x cols), C = a^T B (TRIPLE_MATRIX)
+    awaitable<MatrixTriple> takeMatrix(ll rows, ll cols) {
+        PooledTriple t = co_await take(TRIPLE_MATRIX, rows, cols);
+        co_return std::move(t.matrix);
+    }
+
+    // Ends the session with P2 (P0 sends TRIPLE_END); both parties return once
+    // their reader has seen the echoed end, i.e. every requested triple arrived.
+    awaitable<void> finish() {
+        #ifdef ROLE_p0
+        outbox.push_back(TripleRequest{TRIPLE_END, 0, 0});
+        kickWriter();
+        #endif
+        while (!done) co_await waitArrival();
+        if (!error.empty()) throw runtime_error("triple pool: " + error);
+    }
+
+    const TriplePoolStats& stats() const { return st; }
+
+    void printStats(ostream& os, const string& role) const {
+        uint64_t unused = 0;
+        for (const auto& kv : queues) unused += kv.second.ready.size();
+        os << role << ": triple pool takes=" << st.takes << " hits=" << st.hits
+           << " misses=" << st.misses << " wait_us=" << st.waitUs
+           << " requested=" << st.requested << " received=" << st.received << " bytes_in=" << st.bytesIn
+           << " peak_queued=" << st.peakQueued << " unused=" << unused << endl;
+    }
+
+private:
+    struct PooledTriple {
+        ScalarVecTriple scalarVec;
+        InnerProductTriple innerProduct;
+        MatrixTriple matrix;
+    };
+
+    struct ShapeQueue {
+        deque<PooledTriple> ready;
+        size_t inFlight = 0;   // requested by P0, not yet read
+        size_t depth = 1, lowWatermark = 0;
+        size_t budget = SIZE_MAX;   // P0: requests left before the expected demand is met
+    };
+
+    using ShapeKey = tuple<ll, ll, ll>;
+
+    ShapeQueue& queueFor(ll kind, ll rows, ll cols) {
+        auto [it, added] = queues.try_emplace(ShapeKey{kind, rows, cols});
+        ShapeQueue& q = it->second;
+        if (added) {
+            size_t bytes = tripleWireBytes(kind, rows, cols);
+            q.depth = max<size_t>(1, min(kTriplePoolDepth, kTriplePoolBytes / max<size_t>(bytes, 1)));
+            q.lowWatermark = q.depth / 2;
+        }
+        return q;
+    }
+
+    // P0: top the shape up to its depth, within its budget, once it is at or
+    // below the low watermark
+    void refill(ll kind, ll rows, ll cols, ShapeQueue& q) {
+        size_t have = q.ready.size() + q.inFlight;
+        if (have > q.lowWatermark) return;
+        request(kind, rows, cols, q, min(q.depth - have, q.budget));
+    }
+
+    void request(ll kind, ll rows, ll cols, ShapeQueue& q, size_t count) {
+        #ifndef ROLE_p0
+        (void)kind; (void)rows; (void)cols; (void)q; (void)count;
+        return;   // P1 only receives what P0 asked for
+        #else
+        if (count == 0) return;
+        for (size_t i = 0; i < count; ++i) outbox.push_back(TripleRequest{kind, rows, cols});
+        q.inFlight += count;
+        q.budget -= min(count, q.budget);
+        st.requested += count;
+        kickWriter();
+        #endif
+    }
+
+    awaitable<PooledTriple> take(ll kind, ll rows, ll cols) {
+        ShapeQueue& q = queueFor(kind, rows, cols);
+        ++st.takes;
+        refill(kind, rows, cols, q);
+        if (q.ready.empty() && q.inFlight == 0) request(kind, rows, cols, q, 1);   // past the expected demand
+        if (!q.ready.empty()) {
+            ++st.hits;
+        } else {
+            ++st.misses;
+            auto t0 = chrono::steady_clock::now();
+            while (q.ready.empty()) {
+                if (!error.empty()) throw runtime_error("triple pool: " + error);
+                if (done) throw runtime_error("triple pool: P2 ended the session");
+                co_await waitArrival();
+            }
+            st.waitUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0).count();
+        }
+        PooledTriple t = std::move(q.ready.front());
+        q.ready.pop_front();
+        --queued;
+        refill(kind, rows, cols, q);
+        co_return t;
+    }
+
+    // woken by the reader whenever a triple (or the end of the stream) arrives
+    awaitable<void> waitArrival() {
+        boost::system::error_code ec;
+        arrived.expires_at(boost::asio::steady_timer::time_point::max());
+        co_await arrived.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+    }
+
+    // writes queued requests; one writer at a time keeps the headers in order
+    void kickWriter() {
+        if (writing || outbox.empty()) return;
+        writing = true;
+        co_spawn(p2_sock.get_executor(), writeLoop(shared_from_this()), detached);
+    }
+
+    awaitable<void> writeLoop([[maybe_unused]] shared_ptr<TriplePool> self) {   // self keeps the pool alive
+        try {
+            while (!outbox.empty()) {
+                vector<TripleRequest> batch;
+                batch.swap(outbox);
+                co_await boost::asio::async_write(p2_sock, boost::asio::buffer(batch), use_awaitable);
+            }
+        } catch (exception& e) {
+            error = e.what();
+            arrived.cancel();
+        }
+        writing = false;
+    }
+
+    // one WIRE_TRIPLE frame of P2's stream, unpacked into bufs
+    template <typename Buffers>
+    awaitable<void> readFrame(const Buffers& bufs) {
+        frame.resize(wireFrameBytes(wireBufferWords(bufs)));
+        st.bytesIn += co_await boost::asio::async_read(p2_sock, boost::asio::buffer(frame), use_awaitable);
+        decodeBuffers(WIRE_TRIPLE, frame.data(), bufs);
+    }
+
+    // one payload of P2's stream: P0's shares expanded from a seed, or the shares in full
+    template <typename Triple>
+    awaitable<void> readPayload(const TripleRequest& h, bool seeded, Triple& t) {
+        if (seeded) {
+            TripleSeed seed;
+            st.bytesIn += co_await boost::asio::async_read(p2_sock, boost::asio::buffer(&seed, sizeof(seed)), use_awaitable);
+            expandShares(seed, h.rows, h.cols, t);
+        } else {
+            t.resize(h.rows, h.cols);
+            co_await readFrame(t.wireBuffers());
+        }
+    }
+
+    awaitable<void> readLoop([[maybe_unused]] shared_ptr<TriplePool> self) {   // self keeps the pool alive
+        try {
+            for (;;) {
+                TripleRequest h;
+                co_await boost::asio::async_read(p2_sock, boost::asio::buffer(&h, sizeof(h)), use_awaitable);
+                st.bytesIn += sizeof(h);
+                if (h.kind == TRIPLE_END) break;
+
+                bool seeded = h.kind & TRIPLE_SEEDED;
+                h.kind &= ~(ll)TRIPLE_SEEDED;
+                PooledTriple t;
+                if (h.kind == TRIPLE_SCALAR_VEC) co_await readPayload(h, seeded, t.scalarVec);
+                else if (h.kind == TRIPLE_INNER_PRODUCT) co_await readPayload(h, seeded, t.innerProduct);
+                else if (h.kind == TRIPLE_MATRIX) co_await readPayload(h, seeded, t.matrix);
+                else throw runtime_error("unknown triple kind " + to_string(h.kind) + " from P2");
+
+                ShapeQueue& q = queueFor(h.kind, h.rows, h.cols);
+                q.ready.push_back(std::move(t));
+                if (q.inFlight) --q.inFlight;
+                ++st.received;
+                st.peakQueued = max<uint64_t>(st.peakQueued, ++queued);
+                arrived.cancel();
+            }
+        } catch (exception& e) {
+            error = e.what();
+        }
+        done = true;
+        arrived.cancel();
+    }
+
+    tcp::socket& p2_sock;
+    boost::asio::steady_timer arrived;
+    map<ShapeKey, ShapeQueue> queues;
+    vector<TripleRequest> outbox;
+    vector<uint8_t> frame;   // readFrame's buffer, reused for every triple
+    bool writing = false, done = false;
+    string error;
+    uint64_t queued = 0;
+    TriplePoolStats st;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "shares.hpp"
+#include "shared_matrix.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,19 +10,13 @@
 using namespace std;
 typedef long long int ll;
 
-const int mod = 1000000007;
+// Normalize any integer into the ring (ring.hpp)
+inline ll norm(ll x) { return (ll)Ring::fromSigned(x); }
 
-// Normalize into [0, mod)
-inline ll norm(ll x) {
-    x %= mod;
-    if (x < 0) x += mod;
-    return x;
-}
-
-// Modular ops
-inline ll addm(ll a, ll b) { return norm(a + b); }
-inline ll subm(ll a, ll b) { return norm(a - b); }
-inline ll mulm(ll a, ll b) {return norm(a * b); }
+// Ring ops on reduced elements
+inline ll addm(ll a, ll b) { return (ll)Ring::add(a, b); }
+inline ll subm(ll a, ll b) { return (ll)Ring::sub(a, b); }
+inline ll mulm(ll a, ll b) { return (ll)Ring::mul(a, b); }
 
 // write a vector to a file by appending it
 inline void write(const string& filename, const Share& vec) {
@@ -54,6 +49,32 @@ inline vector<Share> read_vector(const string& filename, int k) {
     return all_vectors;
 }
 
+// reads a share matrix (one row of k values per line) into contiguous storage
+inline SharedMatrix read_matrix(const string& filename, int k) {
+    ifstream input(filename);
+    if (!input.is_open()) {
+        throw runtime_error("Could not open file for reading: " + filename);
+    }
+    string line;
+    size_t rows = 0;
+    while (getline(input, line)) ++rows;
+    input.clear();
+    input.seekg(0);
+
+    SharedMatrix m(rows, k);
+    for (size_t r = 0; r < rows && getline(input, line); ++r) {
+        stringstream ss(line);
+        SharedMatrix::Elem* row = m.rowData(r);
+        int c = 0;
+        ll val;
+        while (c < k && ss >> val) row[c++] = (SharedMatrix::Elem)val;
+        if (c != k || (ss >> val)) {
+            throw runtime_error("Malformed data in " + filename + ": unexpected vector size.");
+        }
+    }
+    return m;
+}
+
 // reads the queries from a file
 inline vector<pair<int, int>> read_queries(const string& filename) {
     vector<pair<int, int>> queries;
@@ -34,18 +34,13 @@ static void directStep(vector<Share>& U, vector<Share>& V, int ui, int vj) {
     Share u_old = U[ui];
     Share v_old = V[vj];
 
-    ll dot = 0;
-    for (int t = 0; t < (int)u_old.size(); ++t)
-        dot = addm(dot, mulm(u_old.data[t], v_old.data[t]));
-    ll delta = subm(1, dot);
+    ll delta = subm(1, ringDot(u_old.data.data(), v_old.data.data(), u_old.size()));
 
     // v_j' = v_j + u_i * delta
-    for (int t = 0; t < (int)v_old.size(); ++t)
-        V[vj].data[t] = addm(V[vj].data[t], mulm(u_old.data[t], delta));
+    ringAxpy(V[vj].data.data(), delta, u_old.data.data(), v_old.size());
 
     // u_i' = u_i + v_j * delta
-    for (int t = 0; t < (int)u_old.size(); ++t)
-        U[ui].data[t] = addm(U[ui].data[t], mulm(v_old.data[t], delta));
+    ringAxpy(U[ui].data.data(), delta, v_old.data.data(), u_old.size());
 }
 
 static bool fileWait(const string& path, int max_seconds) {
@@ -0,0 +1,172 @@
+#pragma once
+#include "ring.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef long long int ll;
+
+// Wire format of ring elements (party-to-party share vectors and P2's triple
+// shares). A frame is an 8-byte header, then the elements packed at
+// Ring::kBits bits each (30 for p = 1e9+7), least significant bit first, in
+// ceil(count * kBits / 8) bytes: about 2.1x smaller than raw 64-bit words.
+// Elements must be reduced (ring.hpp); the header's bit width lets the
+// receiver reject a peer built for a different ring.
+
+enum WireType : uint16_t {
+    WIRE_SHARE = 1,    // share vector between P0 and P1
+    WIRE_TRIPLE = 2,   // triple shares from P2, in wireBuffers() order
+};
+
+struct WireHeader {
+    uint16_t type;
+    uint8_t bits;
+    uint8_t reserved;
+    uint32_t count;   // elements in the frame
+};
+static_assert(sizeof(WireHeader) == 8, "WireHeader must have no padding");
+
+// low Ring::kBits bits of a word, the part of it that goes on the wire
+constexpr uint64_t kWireMask = Ring::kBits == 64 ? ~0ULL : (1ULL << Ring::kBits) - 1;
+
+inline size_t wirePayloadBytes(size_t count) { return (count * Ring::kBits + 7) / 8; }
+inline size_t wireFrameBytes(size_t count) { return sizeof(WireHeader) + wirePayloadBytes(count); }
+
+// Appends elements to a payload of wirePayloadBytes(count) bytes. An
+// unreduced element trips the assert in debug builds; otherwise it is cut to
+// kBits so it cannot spill into its neighbours.
+class WirePacker {
+public:
+    explicit WirePacker(uint8_t* out) : out(out) {}
+
+    void put(uint64_t v) {
+        assert(Ring::kModulus == 0 || v < Ring::kModulus);
+        acc |= (unsigned __int128)(v & kWireMask) << filled;
+        filled += Ring::kBits;
+        if (filled >= 64) {
+            uint64_t w = (uint64_t)acc;
+            memcpy(out, &w, 8);
+            out += 8;
+            acc >>= 64;
+            filled -= 64;
+        }
+    }
+
+    // writes the last partial word
+    void finish() {
+        uint64_t w = (uint64_t)acc;
+        memcpy(out, &w, (filled + 7) / 8);
+    }
+
+private:
+    uint8_t* out;
+    unsigned __int128 acc = 0;
+    unsigned filled = 0;
+};
+
+// Reads elements back from a payload of `bytes` bytes
+class WireUnpacker {
+public:
+    WireUnpacker(const uint8_t* in, size_t bytes) : in(in), end(in + bytes) {}
+
+    uint64_t next() {
+        if (filled < Ring::kBits) {
+            uint64_t w = 0;
+            size_t take = (size_t)(end - in) < 8 ? (size_t)(end - in) : 8;
+            memcpy(&w, in, take);
+            in += take;
+            acc |= (unsigned __int128)w << filled;
+            filled += 8 * (unsigned)take;
+        }
+        uint64_t v = (uint64_t)acc & kWireMask;
+        acc >>= Ring::kBits;
+        filled -= Ring::kBits;
+        return v;
+    }
+
+private:
+    const uint8_t* in;
+    const uint8_t* end;
+    unsigned __int128 acc = 0;
+    unsigned filled = 0;
+};
+
+inline WireHeader wireHeader(WireType type, size_t count) {
+    if (count > UINT32_MAX) throw std::length_error("wire frame of " + std::to_string(count) + " elements");
+    return WireHeader{type, (uint8_t)Ring::kBits, 0, (uint32_t)count};
+}
+
+// frame of v[0, count) into out[0, wireFrameBytes(count))
+inline void encodeFrame(WireType type, const ll* v, size_t count, uint8_t* out) {
+    WireHeader h = wireHeader(type, count);
+    memcpy(out, &h, sizeof(h));
+    WirePacker pack(out + sizeof(h));
+    for (size_t i = 0; i < count; ++i) pack.put((uint64_t)v[i]);
+    pack.finish();
+}
+
+inline std::vector<uint8_t> encodeFrame(WireType type, const ll* v, size_t count) {
+    std::vector<uint8_t> frame(wireFrameBytes(count));
+    encodeFrame(type, v, count, frame.data());
+    return frame;
+}
+
+// throws unless the frame holds `count` elements of `type` at this build's width
+inline void checkFrame(WireType type, const uint8_t* frame, size_t count) {
+    WireHeader h;
+    memcpy(&h, frame, sizeof(h));
+    if (h.bits != Ring::kBits)
+        throw std::runtime_error("peer packs " + std::to_string(h.bits) + "-bit elements, this build " +
+                                 std::to_string(Ring::kBits) + " (built for a different ring?)");
+    if (h.type != type || h.count != count)
+        throw std::runtime_error("unexpected wire frame: type " + std::to_string(h.type) + " with " +
+                                 std::to_string(h.count) + " elements, wanted type " + std::to_string(type) +
+                                 " with " + std::to_string(count));
+}
+
+// out[0, count) from a frame of wireFrameBytes(count) bytes
+inline void decodeFrame(WireType type, const uint8_t* frame, size_t count, ll* out) {
+    checkFrame(type, frame, count);
+    WireUnpacker unpack(frame + sizeof(WireHeader), wirePayloadBytes(count));
+    for (size_t i = 0; i < count; ++i) out[i] = (ll)unpack.next();
+}
+
+// elements in the ll arrays bufs[0], bufs[1], ... (asio buffers)
+template <typename Buffers>
+inline size_t wireBufferWords(const Buffers& bufs) {
+    size_t count = 0;
+    for (const auto& b : bufs) count += b.size() / sizeof(ll);
+    return count;
+}
+
+// one frame of the ll arrays bufs[0], bufs[1], ..., concatenated
+template <typename Buffers>
+inline std::vector<uint8_t> encodeBuffers(WireType type, const Buffers& bufs) {
+    size_t count = wireBufferWords(bufs);
+    std::vector<uint8_t> frame(wireFrameBytes(count));
+    WireHeader h = wireHeader(type, count);
+    memcpy(frame.data(), &h, sizeof(h));
+    WirePacker pack(frame.data() + sizeof(h));
+    for (const auto& b : bufs) {
+        const ll* v = (const ll*)b.data();
+        for (size_t i = 0; i < b.size() / sizeof(ll); ++i) pack.put((uint64_t)v[i]);
+    }
+    pack.finish();
+    return frame;
+}
+
+// the inverse: scatters a frame over bufs[0], bufs[1], ...
+template <typename Buffers>
+inline void decodeBuffers(WireType type, const uint8_t* frame, const Buffers& bufs) {
+    size_t count = wireBufferWords(bufs);
+    checkFrame(type, frame, count);
+    WireUnpacker unpack(frame + sizeof(WireHeader), wirePayloadBytes(count));
+    for (const auto& b : bufs) {
+        ll* v = (ll*)b.data();
+        for (size_t i = 0; i < b.size() / sizeof(ll); ++i) v[i] = (ll)unpack.next();
+    }
+}
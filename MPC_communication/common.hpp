@@ -21,6 +21,10 @@ inline uint32_t random_uint32() {
     return dis(gen);
 }
 
+inline uint64_t random_uint64() {
+    return ((uint64_t)random_uint32() << 32) | random_uint32();
+}
+
 // Blind by XOR mask
 inline uint32_t blind_value(uint32_t v) {
     return v ^ 0xDEADBEEF;
@@ -76,10 +76,10 @@ int main(int argc, char* argv[]) {
             // User-only line (for MPC parties)
             queries_users << ui << "\n";
 
-            // Build one-hot e_j and additive shares s0, s1 mod mod
+            // Build one-hot e_j and additive shares s0, s1 in the ring
             vector<ll> s0(n), s1(n);
             for (int idx = 0; idx < n; ++idx) {
-                ll r = random_uint32() % mod;
+                ll r = (ll)Ring::fromWord(random_uint64());
                 s0[idx] = r;
                 ll e = (idx == vj) ? 1 : 0;
                 s1[idx] = subm(e,r);
@@ -4,22 +4,12 @@
 #include "shares.hpp"
 #include <vector>
 #include "utility.hpp"
+#include "triple_pool.hpp"
+#include "transport.hpp"
 using namespace std;
 typedef long long int ll;
 
-// coroutine to send a vector share
-awaitable<void> send_vec(tcp::socket& sock, const Share& vec) {
-    co_await boost::asio::async_write(sock, boost::asio::buffer(vec.data), use_awaitable);
-}
-
-// coroutine to receive a vector share
-awaitable<Share> recv_vec(tcp::socket& sock, size_t k) {
-    Share vec(k);
-    co_await boost::asio::async_read(sock, boost::asio::buffer(vec.data), use_awaitable);
-    co_return vec;
-}
-
-// coroutine to send a single value
+// coroutine to send a single value (a raw control word, not a ring element)
 awaitable<void> send_val(tcp::socket& sock, ll val) {
     co_await boost::asio::async_write(sock, boost::asio::buffer(&val, sizeof(val)), use_awaitable);
 }
@@ -31,105 +21,153 @@ awaitable<ll> recv_val(tcp::socket& sock) {
     co_return val;
 }
 
+// calls of one MPC primitive and the peer exchanges (rounds) they took
+struct RoundCounter {
+    const char* name;
+    uint64_t calls = 0;
+    uint64_t rounds = 0;
+};
+
 class MPCProtocol {
 private:
-    tcp::socket& peer_sock;
-    tcp::socket& p2_sock;
+    PeerTransport& net;
+    shared_ptr<TriplePool> pool;      // prefetched correlated randomness from P2
+    RoundCounter dotRounds{"MPC_DOTPRODUCT"}, scalarVecRounds{"scalarVecProd"}, matRounds{"MPC_MATVEC_DOTPRODUCT"};
+    RingAccumulator matAcc{0};        // MPC_MATVEC_DOTPRODUCT's z_b, reused across queries
+
+    // opens masked values: net's outgoing messages [0, messages) go out and the
+    // peer's arrive in its incoming slots, in one full-duplex exchange counted against c
+    awaitable<void> openMasked(RoundCounter& c, size_t messages) {
+        ++c.rounds;
+        co_await net.exchange(messages);
+    }
     // Securely computes the dot product of two secret-shared vectors based on the image provided.
     awaitable<ll> MPC_DOTPRODUCT(const Share& x_b, const Share& y_b, int k) {
-        // beaver triplit
-        vector<BeaverTriple> triples = co_await getBeaverTriple(k);
-        Share a_b(k), b_b(k);
-        vector<ll> c_b(k);
-        for(int i=0; i<k; i++) {
-            a_b.data[i] = triples[i].a;
-            b_b.data[i] = triples[i].b;
-            c_b[i] = triples[i].c;
-        }
-        
-        // blinding the values 
-        Share alpha_b = x_b + a_b;
-        Share beta_b  = y_b + b_b;
-
-        // Exchange masked values to reconstruct them publicly
-        co_await send_vec(peer_sock, alpha_b);
-        Share alpha_peer = co_await recv_vec(peer_sock, k);
-        Share alpha = alpha_b + alpha_peer;
-
-        co_await send_vec(peer_sock, beta_b);
-        Share beta_peer = co_await recv_vec(peer_sock, k);
-        Share beta = beta_b + beta_peer;
-
-        ll prodShare = 0;
-        for (int i = 0; i < k; i++) {
-            // (x+a)*y_b - (y+b)*a_b + c_b <- beaver method to get mulmiplication share
-            ll term = addm(subm(mulm(alpha.data[i], y_b.data[i]),mulm(beta.data[i],  a_b.data[i])),c_b[i]);
-            prodShare = addm(prodShare, term);
-        }
-        co_return prodShare;
+        ++dotRounds.calls;
+        // inner-product triple: a, b of length k and c = <a, b>
+        InnerProductTriple t = co_await getInnerProductTriple(k);
+
+        // blinding the values: alpha_b = x_b + a_b and beta_b = y_b + b_b,
+        // two messages in one write
+        ll* alpha_b = net.outgoing(0, k);
+        ll* beta_b = net.outgoing(1, k);
+        copy(x_b.data.begin(), x_b.data.begin() + k, alpha_b);
+        copy(y_b.data.begin(), y_b.data.begin() + k, beta_b);
+        ringAddInto(alpha_b, t.a.data(), k);
+        ringAddInto(beta_b, t.b.data(), k);
+
+        // Exchange masked values to reconstruct them publicly (one round)
+        co_await openMasked(dotRounds, 2);
+        ll* alpha = net.incoming(0);
+        ll* beta = net.incoming(1);
+        ringAddInto(alpha, alpha_b, k);
+        ringAddInto(beta, beta_b, k);
+
+        // <x+a, y_b> - <y+b, a_b> + c_b <- beaver method to get mulmiplication share
+        co_return addm(t.c, subm(ringDot(alpha, y_b.data.data(), k), ringDot(beta, t.a.data(), k)));
     }
     
     // Securely computes the product of a secret-shared scalar and a secret-shared vector
     awaitable<Share> scalarVecProd(ll scalar_share, const Share& vec_share, int k) {
-        // Get Beaver triples from P2
-        vector<BeaverTriple> triples = co_await getBeaverTriple(k);
-        Share a_b(k), b_b(k); // a is scalar, b is vector
-        vector<ll> c_b(k);
-        for(int i=0; i<k; ++i) {
-            a_b.data[i] = triples[i].a; // Re-using vector share for scalar shares
-            b_b.data[i] = triples[i].b;
-            c_b[i] = triples[i].c;
-        }
-        
-        // Mask scalar and vector (mod)
-        ll alpha_b = addm(scalar_share, a_b.data[0]);
-        Share beta_b = vec_share + b_b;
-
-        // Exchange and reconstruct (mod)
-        co_await send_val(peer_sock, alpha_b);
-        ll alpha_peer = co_await recv_val(peer_sock);
-        ll alpha = addm(alpha_b, alpha_peer);
-
-        co_await send_vec(peer_sock, beta_b);
-        Share beta_peer = co_await recv_vec(peer_sock, k);
-        Share beta = beta_b + beta_peer;
-
-        Share result(k);
-        for (int i = 0; i < k; i++) {
-            // (s+a)*v_b[i] - (v[i]+b[i])*a + c[i]
-            result.data[i] = addm(subm(mulm(alpha,vec_share.data[i]), mulm(beta.data[i],a_b.data[0])), c_b[i]);
-        }
+        ++scalarVecRounds.calls;
+        // scalar x vector triple: one a, b of length k, c[i] = a * b[i]
+        ScalarVecTriple t = co_await getScalarVecTriple(k);
+
+        // Mask scalar and vector (mod): alpha_b and beta_b, two messages in one write
+        ll* alpha_b = net.outgoing(0, 1);
+        ll* beta_b = net.outgoing(1, k);
+        alpha_b[0] = addm(scalar_share, t.a);
+        copy(vec_share.data.begin(), vec_share.data.begin() + k, beta_b);
+        ringAddInto(beta_b, t.b.data(), k);
+
+        // Exchange and reconstruct (mod), one round
+        co_await openMasked(scalarVecRounds, 2);
+        ll alpha = addm(net.incoming(0)[0], alpha_b[0]);
+        ll* beta = net.incoming(1);
+        ringAddInto(beta, beta_b, k);
+
+        // (s+a)*v_b[i] - (v[i]+b[i])*a + c[i]
+        Share result(std::move(t.c));
+        ringAxpy(result.data.data(), alpha, vec_share.data.data(), k);
+        ringAxpy(result.data.data(), (ll)Ring::neg(t.a), beta, k);
         co_return result;
     }
     
-    // request for k Beaver mulmiplication triples from P2
-    awaitable<vector<BeaverTriple>> getBeaverTriple(int k) {
-        // Only P0 sends the request to P2; P1 passively receives triples.
+    // correlations from the pool (requested from P2 ahead of time by P0)
+    awaitable<InnerProductTriple> getInnerProductTriple(int k) {
+        co_return co_await pool->takeInnerProduct(k);
+    }
+
+    awaitable<ScalarVecTriple> getScalarVecTriple(int k) {
+        co_return co_await pool->takeScalarVec(k);
+    }
+
+    // vector-matrix triple (a: rows, B: rows x cols, C = a^T B) from the pool
+    awaitable<MatrixTriple> getMatrixTriple(size_t rows, int cols) {
+        co_return co_await pool->takeMatrix((ll)rows, cols);
+    }
+
+    // Batched matrix-vector dot product: all k inner products <x, V_col[d]> at once.
+    // One triple request and one exchange of e = x + a and F = V + B, then
+    // z_b = [b = 0] e^T F - e^T B_b - a_b^T F + C_b. V is read row by row in place.
+    awaitable<Share> MPC_MATVEC_DOTPRODUCT(const Share& x_b, const vector<Share>& V_rows_b, int n, int k) {
+        ++matRounds.calls;
+        MatrixTriple t = co_await getMatrixTriple(n, k);
+
+        // e_b (n entries) and F_b (row-major) go out as two messages in one write
+        ll* e_b = net.outgoing(0, n);
+        ll* F_b = net.outgoing(1, (size_t)n * k);
+        copy(x_b.data.begin(), x_b.data.begin() + n, e_b);
+        for (int r = 0; r < n; ++r)
+            copy(V_rows_b[r].data.begin(), V_rows_b[r].data.begin() + k, F_b + (size_t)r * k);
+        ringAddInto(e_b, t.a.data(), n);
+        ringAddInto(F_b, t.B.data(), (size_t)n * k);
+        co_await openMasked(matRounds, 2);
+        ll* e_open = net.incoming(0);
+        ll* F_open = net.incoming(1);
+        ringAddInto(e_open, e_b, n);
+        ringAddInto(F_open, F_b, (size_t)n * k);
+
+        // per row: z_b += ([b = 0] e - a_b) F_r - e B_b,r, reduced once at the end
+        RingAccumulator& z = matAcc;
+        z.reset(k);
+        for (int r = 0; r < n; ++r) {
+            ll e = e_open[r];
+            const ll* F = F_open + (size_t)r * k;
         #ifdef ROLE_p0
-        co_await send_val(p2_sock, k);
+            z.axpy(subm(e, t.a[r]), F);
+        #else
+            z.axpy((ll)Ring::neg(t.a[r]), F);
         #endif
-
-        vector<BeaverTriple> triples(k);
-        co_await boost::asio::async_read(p2_sock, boost::asio::buffer(triples), use_awaitable);
-        co_return triples;
+            z.axpy((ll)Ring::neg(e), t.B.data() + (size_t)r * k);
+        }
+        Share out(std::move(t.C));
+        z.addTo(out.data.data());
+        co_return out;
     }
 
     // Select item v_j obliviously using secret-shared one-hot s (length n):
-    // v_sel[d] = <s, V_col[d]> for d=0..k-1
+    // v_sel[d] = <s, V_col[d]> for d=0..k-1, all k coordinates in one round
     awaitable<Share> select_item_oblivious(const Share& s_b,const vector<Share>& V_rows_b, int n, int k) {
-        Share select_b(k);
-        for (int d = 0; d < k; d++) {
-            Share col_d(n);
-            for (int t = 0; t < n; ++t) col_d.data[t] = V_rows_b[t].data[d];
-            ll coord_share = co_await MPC_DOTPRODUCT(s_b, col_d, n);
-            select_b.data[d] = coord_share;
-        }
-        co_return select_b;
+        co_return co_await MPC_MATVEC_DOTPRODUCT(s_b, V_rows_b, n, k);
     }
 
 public:
 
-    MPCProtocol(tcp::socket& peer, tcp::socket& p2) : peer_sock(peer), p2_sock(p2) {}
+    MPCProtocol(PeerTransport& peer, tcp::socket& p2) : net(peer), pool(make_shared<TriplePool>(p2)) {
+        pool->start();
+    }
+
+    TriplePool& triplePool() { return *pool; }
+
+    // one line per primitive: calls, peer rounds and rounds per call
+    void printRounds(ostream& os, const string& role) const {
+        for (const RoundCounter* c : {&dotRounds, &scalarVecRounds, &matRounds}) {
+            os << role << ": " << c->name << " calls=" << c->calls << " rounds=" << c->rounds;
+            if (c->calls) os << " (" << (double)c->rounds / c->calls << " per call)";
+            os << endl;
+        }
+    }
 
     // function for full secure update protocol for u_i <- u_i + v_j * (1 - <u_i, v_j>)
     awaitable<Share> updateProtocol(const Share& ui, const Share& vj, int k) {
@@ -142,8 +180,8 @@ public:
             delta_share = subm(0, prodShare);
         #endif
 
-        Share prod_vec_share = co_await scalarVecProd(delta_share, vj, k);
-        Share u_prime_b = ui + prod_vec_share;
+        Share u_prime_b = co_await scalarVecProd(delta_share, vj, k);
+        u_prime_b += ui;
         co_return u_prime_b;
     }
 
@@ -47,15 +47,16 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
         tcp::socket peer_sock = co_await setup_peer_connection(io_context);
         cout << role << ": Connections established." << endl;
 
-        // Identify to P2 (P0=0, P1=1)
+        // Identify to P2 (P0=0, P1=1) and name the session both parties share
         {
-            uint8_t rid =
+            DealerHello hello{
             #ifdef ROLE_p0
-                0;
+                0,
             #else
-                1;
+                1,
             #endif
-            co_await boost::asio::async_write(p2_sock, boost::asio::buffer(&rid, 1), use_awaitable);
+                sessionIdFromEnv()};
+            co_await boost::asio::async_write(p2_sock, boost::asio::buffer(&hello, sizeof(hello)), use_awaitable);
         }
 
         // reading the data 
@@ -84,7 +85,14 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
              << " queries(users_only)=" << users_only.size()
              << " S-lines=" << s_shares.size() << endl;
 
-        MPCProtocol mpc(peer_sock, p2_sock);
+        PeerTransport net(peer_sock);
+        MPCProtocol mpc(net, p2_sock);
+        // fill the triple pool for every per-query shape before the first query;
+        // each query takes one triple of each, so no more than that is requested
+        size_t queries = users_only.size();
+        mpc.triplePool().prefetch(TRIPLE_MATRIX, n, k, queries);        // selection
+        mpc.triplePool().prefetch(TRIPLE_INNER_PRODUCT, 1, k, queries); // dot product
+        mpc.triplePool().prefetch(TRIPLE_SCALAR_VEC, 1, k, queries);    // scalar x vector
 
         // final reconstructed vector per user
         #ifdef ROLE_p0
@@ -101,34 +109,36 @@ awaitable<void> run_protocol(boost::asio::io_context& io_context, int k) {
             // securely updating the user share
             Share& u_b = u_shares[user_idx];
             Share u_prime_b = co_await mpc.updateProtocol(u_b, v_sel_b, k);
-            u_shares[user_idx] = u_prime_b;
 
-            // Reconstruct updated vector
-            co_await send_vec(peer_sock, u_prime_b);
-            Share u_prime_peer = co_await recv_vec(peer_sock, k);
-            Share u_reconstructed = u_prime_b + u_prime_peer;
+            // Reconstruct updated vector in the transport's slots
+            ll* u_prime_mine = net.outgoing(0, k);
+            copy(u_prime_b.data.begin(), u_prime_b.data.end(), u_prime_mine);
+            co_await net.exchange(1);
+            ll* u_reconstructed = net.incoming(0);
+            ringAddInto(u_reconstructed, u_prime_mine, k);
 
-            // Re-share randomized
+            // Re-share randomized: both parties overwrite u_b in place
             #ifdef ROLE_p0
-                Share new_p0(k);
-                new_p0.randomizer();                 // fresh random share for P0
-                Share new_p1 = u_reconstructed - new_p0; // complementary share for P1
-                u_shares[user_idx] = new_p0;
-                co_await send_vec(peer_sock, new_p1);
+                u_b.randomizer();                    // fresh random share for P0
+                ll* new_p1 = net.outgoing(0, k);     // complementary share for P1
+                copy(u_reconstructed, u_reconstructed + k, new_p1);
+                ringSubInto(new_p1, u_b.data.data(), k);
+                co_await net.send(1);
             #else
-                Share new_p1 = co_await recv_vec(peer_sock, k);
-                u_shares[user_idx] = new_p1;
+                net.expect(0, k);
+                co_await net.recv(1);
+                copy(net.incoming(0), net.incoming(0) + k, u_b.data.begin());
             #endif
 
             #ifdef ROLE_p0
-            final_reconstructed[user_idx] = u_reconstructed;
+            final_reconstructed[user_idx].data.assign(u_reconstructed, u_reconstructed + k);
             #endif
         }
 
-        // Signal end of protocol to P2
-        #ifdef ROLE_p0
-            co_await send_val(p2_sock, 0);
-        #endif
+        // Signal end of protocol to P2 and wait for the triples still in flight
+        co_await mpc.triplePool().finish();
+        mpc.printRounds(cout, role);
+        mpc.triplePool().printStats(cout, role);
 
         // writing final result and ok flag in file for verification 
         #ifdef ROLE_p0
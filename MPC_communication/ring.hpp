@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+
+// Arithmetic ring of the shares, fixed at compile time. Every binary of a
+// deployment (gen_data, p0, p1, p2, verify) must be built with the same choice:
+//   default        Z_p, p = 1e9+7
+//   -DRING_M61     Z_p, p = 2^61-1, reduced with shifts and adds instead of %
+//   -DRING_Z2K64   Z_{2^64}, native wrap-around (no reduction at all)
+//
+// Elements are kept in [0, kModulus) as uint64 (Z_{2^64}: every word), and
+// every operation takes and returns reduced elements; Storage is the narrowest
+// word that holds one, for dense matrices of shares, and kBits the bits per
+// element on the wire (wire_codec.hpp). For lazy reduction each
+// ring also has an accumulator word Acc: up to kLazyTerms products from
+// mulAcc (plus one reduced element) can be summed in it before reduceAcc.
+
+// Z_p for p = 1e9+7: products of elements fit in 64 bits
+struct Zp1e9Ring {
+    static constexpr uint64_t P = 1000000007ULL;
+    static constexpr uint64_t kModulus = P;
+    static constexpr bool kHasHalf = true;   // 2 is invertible
+    static constexpr const char* kName = "Z_p (p = 1e9+7)";
+    using Storage = uint32_t;
+    static constexpr unsigned kBits = 30;
+
+    // uniform word -> element (bias below 2^-33)
+    static uint64_t fromWord(uint64_t w) { return w % P; }
+    static uint64_t fromSigned(int64_t x) {
+        int64_t r = x % (int64_t)P;
+        return (uint64_t)(r < 0 ? r + (int64_t)P : r);
+    }
+    static uint64_t add(uint64_t a, uint64_t b) {
+        uint64_t s = a + b;
+        return s >= P ? s - P : s;
+    }
+    static uint64_t sub(uint64_t a, uint64_t b) { return a >= b ? a - b : a + P - b; }
+    static uint64_t neg(uint64_t a) { return a == 0 ? 0 : P - a; }
+    static uint64_t mul(uint64_t a, uint64_t b) { return a * b % P; }
+    static uint64_t half() { return (P + 1) / 2; }
+
+    // products are below 2^60, so 15 of them fit in 64 bits
+    using Acc = uint64_t;
+    static constexpr unsigned kLazyTerms = 15;
+    static Acc mulAcc(uint64_t a, uint64_t b) { return a * b; }
+    static uint64_t reduceAcc(Acc x) { return x % P; }
+};
+
+// Z_p for the Mersenne prime p = 2^61 - 1: since 2^61 = 1 (mod p), a word x reduces
+// to (x & p) + (x >> 61) plus at most one subtraction of p
+struct Mersenne61Ring {
+    static constexpr uint64_t kModulus = (1ULL << 61) - 1;
+    static constexpr bool kHasHalf = true;
+    static constexpr const char* kName = "Z_p (p = 2^61-1)";
+    using Storage = uint64_t;
+    static constexpr unsigned kBits = 61;
+
+    static uint64_t fold(uint64_t x) {
+        x = (x & kModulus) + (x >> 61);
+        return x >= kModulus ? x - kModulus : x;
+    }
+    static uint64_t fromWord(uint64_t w) { return fold(w); }
+    static uint64_t fromSigned(int64_t x) {
+        return x >= 0 ? fromWord((uint64_t)x) : neg(fromWord((uint64_t)-(x + 1) + 1));
+    }
+    static uint64_t add(uint64_t a, uint64_t b) { return fold(a + b); }
+    static uint64_t sub(uint64_t a, uint64_t b) { return a >= b ? a - b : a + kModulus - b; }
+    static uint64_t neg(uint64_t a) { return a == 0 ? 0 : kModulus - a; }
+    static uint64_t mul(uint64_t a, uint64_t b) { return reduceAcc(mulAcc(a, b)); }
+    static uint64_t half() { return (kModulus + 1) / 2; }
+
+    // products are below 2^122, so 32 of them fit in 128 bits
+    using Acc = unsigned __int128;
+    static constexpr unsigned kLazyTerms = 32;
+    static Acc mulAcc(uint64_t a, uint64_t b) { return (Acc)a * b; }
+    static uint64_t reduceAcc(Acc x) {
+        return fold(((uint64_t)x & kModulus) + ((uint64_t)(x >> 61) & kModulus) + (uint64_t)(x >> 122));
+    }
+};
+
+// Z_{2^64}: all arithmetic wraps; 2 has no inverse
+struct Z2k64Ring {
+    static constexpr uint64_t kModulus = 0;   // 2^64
+    static constexpr bool kHasHalf = false;
+    static constexpr const char* kName = "Z_{2^64}";
+    using Storage = uint64_t;
+    static constexpr unsigned kBits = 64;
+
+    static uint64_t fromWord(uint64_t w) { return w; }
+    static uint64_t fromSigned(int64_t x) { return (uint64_t)x; }
+    static uint64_t add(uint64_t a, uint64_t b) { return a + b; }
+    static uint64_t sub(uint64_t a, uint64_t b) { return a - b; }
+    static uint64_t neg(uint64_t a) { return 0 - a; }
+    static uint64_t mul(uint64_t a, uint64_t b) { return a * b; }
+
+    // wrap-around is already reduction
+    using Acc = uint64_t;
+    static constexpr unsigned kLazyTerms = ~0u;
+    static Acc mulAcc(uint64_t a, uint64_t b) { return a * b; }
+    static uint64_t reduceAcc(Acc x) { return x; }
+};
+
+#if defined(RING_M61) && defined(RING_Z2K64)
+#error "choose at most one of RING_M61 and RING_Z2K64"
+#elif defined(RING_M61)
+using Ring = Mersenne61Ring;
+#elif defined(RING_Z2K64)
+using Ring = Z2k64Ring;
+#else
+using Ring = Zp1e9Ring;
+#endif
@@ -0,0 +1,241 @@
+#pragma once
+#include "ring.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SHARE_KERNELS_HAVE_AVX2 1
+#endif
+
+typedef long long int ll;
+
+// Kernels over share vectors (arrays of reduced ring elements, ring.hpp).
+//
+// Every kernel reduces once per output instead of once per operation: products
+// are summed in the ring's wide accumulator and reduced at the end (or every
+// kLazyTerms terms). For Z_p with p = 1e9+7, elements fit in 32 bits and the
+// kernels run four lanes at a time with AVX2 when the CPU has it: products
+// are reduced by Montgomery multiplication (R = 2^32) and dot products sum the
+// low and high halves of each product separately, so nothing overflows and
+// only the final sum is reduced. Other rings and CPUs use the scalar loops.
+
+namespace share_kernels {
+
+inline bool useAvx2() {
+#if defined(SHARE_KERNELS_HAVE_AVX2) && !defined(SHARE_KERNELS_SCALAR)
+    static const bool avx2 = std::is_same_v<Ring, Zp1e9Ring> && __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+namespace avx2 {
+constexpr uint64_t P = Zp1e9Ring::P;
+constexpr uint32_t kPInv = [] {   // -p^{-1} mod 2^32, by Newton iteration
+    uint32_t inv = (uint32_t)P;
+    for (int i = 0; i < 5; ++i) inv *= 2 - (uint32_t)P * inv;
+    return (uint32_t)(0 - inv);
+}();
+constexpr uint64_t kR2 = (uint64_t)((((unsigned __int128)1) << 64) % P);   // R^2 mod p
+
+// a * 2^32 mod p: a scalar in Montgomery form
+inline uint64_t toMont(uint64_t a) { return (a << 32) % P; }
+
+__attribute__((target("avx2")))
+inline __m256i condSub(__m256i x) {
+    const __m256i p = _mm256_set1_epi64x((long long)P);
+    __m256i ge = _mm256_cmpgt_epi64(x, _mm256_set1_epi64x((long long)P - 1));
+    return _mm256_sub_epi64(x, _mm256_and_si256(ge, p));
+}
+
+// x * 2^-32 mod p for x < p * 2^32, fully reduced
+__attribute__((target("avx2")))
+inline __m256i redc(__m256i x) {
+    const __m256i p = _mm256_set1_epi64x((long long)P);
+    __m256i m = _mm256_mul_epu32(x, _mm256_set1_epi64x(kPInv));
+    __m256i t = _mm256_srli_epi64(_mm256_add_epi64(x, _mm256_mul_epu32(m, p)), 32);
+    return condSub(t);
+}
+
+__attribute__((target("avx2")))
+inline void addInto(ll* y, const ll* x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i s = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(y + i)), _mm256_loadu_si256((const __m256i*)(x + i)));
+        _mm256_storeu_si256((__m256i*)(y + i), condSub(s));
+    }
+    for (; i < n; ++i) y[i] = (ll)Zp1e9Ring::add(y[i], x[i]);
+}
+
+__attribute__((target("avx2")))
+inline void subInto(ll* y, const ll* x, size_t n) {
+    const __m256i p = _mm256_set1_epi64x((long long)P);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i d = _mm256_sub_epi64(_mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(y + i)), p),
+                                     _mm256_loadu_si256((const __m256i*)(x + i)));
+        _mm256_storeu_si256((__m256i*)(y + i), condSub(d));
+    }
+    for (; i < n; ++i) y[i] = (ll)Zp1e9Ring::sub(y[i], x[i]);
+}
+
+// y *= x: redc(x * y) = xy / R, and redc(xy / R * R^2) = xy
+__attribute__((target("avx2")))
+inline void mulInto(ll* y, const ll* x, size_t n) {
+    const __m256i r2 = _mm256_set1_epi64x((long long)kR2);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = redc(_mm256_mul_epu32(_mm256_loadu_si256((const __m256i*)(y + i)), _mm256_loadu_si256((const __m256i*)(x + i))));
+        _mm256_storeu_si256((__m256i*)(y + i), redc(_mm256_mul_epu32(t, r2)));
+    }
+    for (; i < n; ++i) y[i] = (ll)Zp1e9Ring::mul(y[i], x[i]);
+}
+
+// y += a * x with a in Montgomery form: one redc per element
+__attribute__((target("avx2")))
+inline void axpy(ll* y, ll a, const ll* x, size_t n) {
+    const __m256i am = _mm256_set1_epi64x((long long)toMont((uint64_t)a));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = redc(_mm256_mul_epu32(am, _mm256_loadu_si256((const __m256i*)(x + i))));
+        __m256i s = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(y + i)), t);
+        _mm256_storeu_si256((__m256i*)(y + i), condSub(s));
+    }
+    for (; i < n; ++i) y[i] = (ll)Zp1e9Ring::reduceAcc((uint64_t)y[i] + (uint64_t)a * (uint64_t)x[i]);
+}
+
+// products split into 32-bit halves summed in separate lanes: exact for n < 2^32
+__attribute__((target("avx2")))
+inline ll dot(const ll* x, const ll* y, size_t n) {
+    const __m256i lo32 = _mm256_set1_epi64x(0xffffffffLL);
+    __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i prod = _mm256_mul_epu32(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(y + i)));
+        lo = _mm256_add_epi64(lo, _mm256_and_si256(prod, lo32));
+        hi = _mm256_add_epi64(hi, _mm256_srli_epi64(prod, 32));
+    }
+    alignas(32) uint64_t l[4], h[4];
+    _mm256_store_si256((__m256i*)l, lo);
+    _mm256_store_si256((__m256i*)h, hi);
+    unsigned __int128 sum = 0;
+    for (int j = 0; j < 4; ++j) sum += ((unsigned __int128)h[j] << 32) + l[j];
+    for (; i < n; ++i) sum += (uint64_t)x[i] * (uint64_t)y[i];
+    return (ll)(uint64_t)(sum % P);
+}
+
+// acc[i] += a * x[i] on unreduced 64-bit lanes (the caller flushes every kLazyTerms)
+__attribute__((target("avx2")))
+inline void accumulate(uint64_t* acc, ll a, const ll* x, size_t n) {
+    const __m256i av = _mm256_set1_epi64x(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i prod = _mm256_mul_epu32(av, _mm256_loadu_si256((const __m256i*)(x + i)));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(acc + i)), prod));
+    }
+    for (; i < n; ++i) acc[i] += (uint64_t)a * (uint64_t)x[i];
+}
+} // namespace avx2
+#endif
+
+} // namespace share_kernels
+
+// y[i] += x[i]
+inline void ringAddInto(ll* y, const ll* x, size_t n) {
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+    if (share_kernels::useAvx2()) return share_kernels::avx2::addInto(y, x, n);
+#endif
+    for (size_t i = 0; i < n; ++i) y[i] = (ll)Ring::add(y[i], x[i]);
+}
+
+// y[i] += x[i] on a row stored in Ring::Storage (SharedMatrix)
+template <typename Elem, typename = std::enable_if_t<!std::is_same_v<Elem, ll>>>
+inline void ringAddInto(Elem* y, const ll* x, size_t n) {
+    for (size_t i = 0; i < n; ++i) y[i] = (Elem)Ring::add(y[i], (uint64_t)x[i]);
+}
+
+// y[i] -= x[i]
+inline void ringSubInto(ll* y, const ll* x, size_t n) {
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+    if (share_kernels::useAvx2()) return share_kernels::avx2::subInto(y, x, n);
+#endif
+    for (size_t i = 0; i < n; ++i) y[i] = (ll)Ring::sub(y[i], x[i]);
+}
+
+// y[i] *= x[i]
+inline void ringMulInto(ll* y, const ll* x, size_t n) {
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+    if (share_kernels::useAvx2()) return share_kernels::avx2::mulInto(y, x, n);
+#endif
+    for (size_t i = 0; i < n; ++i) y[i] = (ll)Ring::mul(y[i], x[i]);
+}
+
+// y[i] += a * x[i], one reduction per element
+inline void ringAxpy(ll* y, ll a, const ll* x, size_t n) {
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+    if (share_kernels::useAvx2()) return share_kernels::avx2::axpy(y, a, x, n);
+#endif
+    for (size_t i = 0; i < n; ++i)
+        y[i] = (ll)Ring::reduceAcc((Ring::Acc)(uint64_t)y[i] + Ring::mulAcc(a, x[i]));
+}
+
+// <x, y>, reduced every kLazyTerms products
+inline ll ringDot(const ll* x, const ll* y, size_t n) {
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+    if (share_kernels::useAvx2()) return share_kernels::avx2::dot(x, y, n);
+#endif
+    Ring::Acc acc = 0;
+    unsigned terms = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (terms == Ring::kLazyTerms) { acc = Ring::reduceAcc(acc); terms = 0; }
+        acc += Ring::mulAcc(x[i], y[i]);
+        ++terms;
+    }
+    return (ll)Ring::reduceAcc(acc);
+}
+
+// Sum of scaled vectors, sum_r a_r * x_r, kept unreduced in the ring's
+// accumulator words; each output is reduced once every kLazyTerms terms.
+class RingAccumulator {
+public:
+    explicit RingAccumulator(size_t n) : acc(n, 0) {}
+
+    // += a * x (x has size() elements)
+    void axpy(ll a, const ll* x) {
+        if (terms == Ring::kLazyTerms) flush();
+        ++terms;
+#if defined(SHARE_KERNELS_HAVE_AVX2)
+        // useAvx2() implies Ring = Zp1e9Ring, whose Acc is uint64_t
+        if (share_kernels::useAvx2())
+            return share_kernels::avx2::accumulate(reinterpret_cast<uint64_t*>(acc.data()), a, x, acc.size());
+#endif
+        for (size_t i = 0; i < acc.size(); ++i) acc[i] += Ring::mulAcc(a, x[i]);
+    }
+
+    size_t size() const { return acc.size(); }
+
+    // back to an empty sum of n elements, keeping the storage
+    void reset(size_t n) {
+        acc.assign(n, 0);
+        terms = 0;
+    }
+
+    // out[i] += the accumulated sum
+    void addTo(ll* out) const {
+        for (size_t i = 0; i < acc.size(); ++i) out[i] = (ll)Ring::add(out[i], Ring::reduceAcc(acc[i]));
+    }
+
+private:
+    void flush() {
+        for (auto& a : acc) a = Ring::reduceAcc(a);
+        terms = 1;   // the reduced partial sums count as one term
+    }
+
+    std::vector<Ring::Acc> acc;
+    unsigned terms = 0;
+};
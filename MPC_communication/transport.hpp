@@ -0,0 +1,137 @@
+#pragma once
+#include "common.hpp"
+#include "wire_codec.hpp"
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <array>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+// Link between P0 and P1 that allocates nothing once warmed up.
+//
+// A call sends or receives up to kMaxMessages logical messages (for example
+// alpha and beta of a Beaver multiplication), each one WIRE_SHARE frame
+// (wire_codec.hpp). The outgoing frames are written with one scatter-gather
+// async_write, and the incoming ones are read with one scattering async_read.
+// Messages are composed in, and received into, slots owned by the transport.
+// Slots only ever grow, so after the first query of each shape no call allocates.
+class PeerTransport {
+public:
+    static constexpr size_t kMaxMessages = 4;
+
+    explicit PeerTransport(tcp::socket& sock)
+        : sock(sock), written(sock.get_executor(), boost::asio::steady_timer::time_point::max()) {}
+
+    PeerTransport(const PeerTransport&) = delete;
+    PeerTransport& operator=(const PeerTransport&) = delete;
+
+    tcp::socket& socket() { return sock; }
+
+    // slot for the i-th message of the next send or exchange; valid until outgoing(i) is called again
+    ll* outgoing(size_t i, size_t count) {
+        checkIndex(i);
+        out[i].data.resize(count);
+        return out[i].data.data();
+    }
+
+    // length of the i-th message of the next recv
+    void expect(size_t i, size_t count) {
+        checkIndex(i);
+        in[i].data.resize(count);
+    }
+
+    // the i-th message of the last recv or exchange; valid until the next one
+    ll* incoming(size_t i) {
+        checkIndex(i);
+        return in[i].data.data();
+    }
+
+    // messages [0, messages) from their outgoing slots, in one write
+    awaitable<void> send(size_t messages) {
+        co_await boost::asio::async_write(sock, packOutgoing(messages), use_awaitable);
+    }
+
+    // messages [0, messages), of the lengths given to expect(), into the incoming slots, in one read
+    awaitable<void> recv(size_t messages) {
+        co_await boost::asio::async_read(sock, prepareIncoming(messages), use_awaitable);
+        unpackIncoming(messages);
+    }
+
+    // Sends messages [0, messages) and receives as many, of the same lengths, from
+    // the peer at the same time. The write runs as a plain async operation next to
+    // the awaited read, so two parties exchanging messages larger than the socket
+    // buffers do not deadlock. The write never outlives the call: if the read
+    // fails, the link is dead, so its send side is shut down and the write,
+    // which then fails, is awaited before the error is rethrown.
+    awaitable<void> exchange(size_t messages) {
+        for (size_t i = 0; i < messages; ++i) { checkIndex(i); in[i].data.resize(out[i].data.size()); }
+        writeErr = {};
+        writeDone = false;
+        written.expires_at(boost::asio::steady_timer::time_point::max());
+        boost::asio::async_write(sock, packOutgoing(messages),
+            [this](boost::system::error_code ec, size_t) { writeErr = ec; writeDone = true; written.cancel(); });
+        exception_ptr readErr;
+        try {
+            co_await boost::asio::async_read(sock, prepareIncoming(messages), use_awaitable);
+        } catch (...) {
+            readErr = current_exception();
+            boost::system::error_code ignored;
+            // cancel() would miss a write between two of its write_some steps
+            sock.shutdown(tcp::socket::shutdown_send, ignored);
+        }
+        while (!writeDone) {
+            boost::system::error_code ec;
+            co_await written.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+        if (readErr) rethrow_exception(readErr);
+        if (writeErr) throw boost::system::system_error(writeErr);
+        unpackIncoming(messages);
+    }
+
+private:
+    struct Slot {
+        vector<ll> data;
+        vector<uint8_t> frame;
+    };
+    using ConstBuffers = array<boost::asio::const_buffer, kMaxMessages>;
+    using MutableBuffers = array<boost::asio::mutable_buffer, kMaxMessages>;
+
+    static void checkIndex(size_t i) {
+        if (i >= kMaxMessages) throw out_of_range("peer transport carries at most " + to_string(kMaxMessages) + " messages per call");
+    }
+
+    // frames the outgoing slots; unused entries of the gather list are empty
+    ConstBuffers packOutgoing(size_t messages) {
+        ConstBuffers bufs{};
+        for (size_t i = 0; i < messages; ++i) {
+            Slot& s = out[i];
+            s.frame.resize(wireFrameBytes(s.data.size()));
+            encodeFrame(WIRE_SHARE, s.data.data(), s.data.size(), s.frame.data());
+            bufs[i] = boost::asio::buffer(s.frame);
+        }
+        return bufs;
+    }
+
+    MutableBuffers prepareIncoming(size_t messages) {
+        MutableBuffers bufs{};
+        for (size_t i = 0; i < messages; ++i) {
+            Slot& s = in[i];
+            s.frame.resize(wireFrameBytes(s.data.size()));
+            bufs[i] = boost::asio::buffer(s.frame);
+        }
+        return bufs;
+    }
+
+    void unpackIncoming(size_t messages) {
+        for (size_t i = 0; i < messages; ++i)
+            decodeFrame(WIRE_SHARE, in[i].frame.data(), in[i].data.size(), in[i].data.data());
+    }
+
+    tcp::socket& sock;
+    boost::asio::steady_timer written;   // wakes exchange() when its write completes
+    boost::system::error_code writeErr;  // exchange()'s write, set by its completion handler
+    bool writeDone = true;
+    array<Slot, kMaxMessages> out, in;
+};
@@ -9,19 +9,13 @@
 using namespace std;
 typedef long long int ll;
 
-const int mod = 1000000007;
+// Normalize any integer into the ring (ring.hpp)
+inline ll norm(ll x) { return (ll)Ring::fromSigned(x); }
 
-// Normalize into [0, mod)
-inline ll norm(ll x) {
-    x %= mod;
-    if (x < 0) x += mod;
-    return x;
-}
-
-// Modular ops
-inline ll addm(ll a, ll b) { return norm(a + b); }
-inline ll subm(ll a, ll b) { return norm(a - b); }
-inline ll mulm(ll a, ll b) {return norm(a * b); }
+// Ring ops on reduced elements
+inline ll addm(ll a, ll b) { return (ll)Ring::add(a, b); }
+inline ll subm(ll a, ll b) { return (ll)Ring::sub(a, b); }
+inline ll mulm(ll a, ll b) { return (ll)Ring::mul(a, b); }
 
 // write a vector to a file by appending it
 inline void write(const string& filename, const Share& vec) {
@@ -30,12 +30,8 @@ static unordered_map<int, Share> readMPC_result(const string& path, int k) {
 
 // Direct update: u_i' = u_i + v_j * (1 - <u_i, v_j>) (mirror MPC math mod p)
 static void directProtocol(Share& ui, const Share& vj) {
-    ll dot = 0;
-    for (int i = 0; i < (int)ui.size(); i++)
-        dot = addm(dot, mulm(ui.data[i], vj.data[i]));
-    ll delta = subm(1, dot);
-    for (int i = 0; i < (int)ui.size(); ++i)
-        ui.data[i] = addm(ui.data[i], mulm(vj.data[i], delta));
+    ll delta = subm(1, ringDot(ui.data.data(), vj.data.data(), ui.size()));
+    ringAxpy(ui.data.data(), delta, vj.data.data(), ui.size());
 }
 
 static bool fileWait(const string& path, int max_seconds) {